@@ -0,0 +1,389 @@
+// Host benchmark for the allocator, path parser and FAT16 read and write paths.
+//
+//   bench <fat16 image> [heap megabytes]
+
+#include "host.h"
+#include "config.h"
+#include "status.h"
+#include "disk/bcache.h"
+#include "disk/disk.h"
+#include "disk/streamer.h"
+#include "fs/file.h"
+#include "fs/pparser.h"
+#include "memory/heap/kheap.h"
+#include "string/string.h"
+
+#define BENCH_BIG_FILE          "0:/big.bin"
+#define BENCH_RAM_BIG_FILE      "1:/big.bin"    // the same image again, as a ram disk
+#define BENCH_LOG_FILE          "0:/log.bin"
+#define BENCH_RAM_LOG_FILE      "1:/log.bin"
+#define BENCH_LOG_FILE_SIZE     (2 * 1024 * 1024)
+#define BENCH_NESTED_FILE       "0:/a/b/c.txt"
+#define BENCH_MAX_LIVE          4096
+#define BENCH_READ_BUFFER_SIZE  (256 * 1024)
+
+static char read_buffer[BENCH_READ_BUFFER_SIZE];
+static char write_buffer[BENCH_READ_BUFFER_SIZE];
+static void* live[BENCH_MAX_LIVE];
+
+//--------------------------------------------------------------------------------
+static void bench_report(const char* name, uint64_t ops, uint64_t start_ns)
+{
+    uint64_t elapsed_ns = host_time_ns() - start_ns;
+    if(elapsed_ns == 0)
+    {
+        elapsed_ns = 1;
+    }
+
+    host_printf("%-36s %10llu ops %10.1f ns/op %12.0f ops/s\n", name, (unsigned long long)ops,
+                (double)elapsed_ns / ops, ops * 1e9 / elapsed_ns);
+}
+
+//--------------------------------------------------------------------------------
+static void bench_report_bytes(const char* name, uint64_t bytes, uint64_t start_ns)
+{
+    uint64_t elapsed_ns = host_time_ns() - start_ns;
+    if(elapsed_ns == 0)
+    {
+        elapsed_ns = 1;
+    }
+
+    host_printf("%-36s %10llu KB %10.2f MB/s\n", name, (unsigned long long)(bytes / 1024),
+                (bytes / (1024.0 * 1024.0)) / (elapsed_ns / 1e9));
+}
+
+//--------------------------------------------------------------------------------
+static void bench_print_bcache_stats()
+{
+    struct bcache_stats stats;
+    bcache_get_stats(&stats);
+
+    uint32_t total = stats.hits + stats.misses;
+    host_printf("bcache: %u hits %u misses (%.1f%% hit rate) %u device reads %u evictions %u/%u buffers\n",
+                stats.hits, stats.misses, total ? stats.hits * 100.0 / total : 0.0,
+                stats.device_reads, stats.evictions, stats.total_buffers, stats.max_buffers);
+
+    struct disk_queue_stats queue_stats;
+    disk_queue_get_stats(disk_get(0), &queue_stats);
+    host_printf("disk queue: %u requests %u reads %u merged %u bounced, max depth %u\n",
+                queue_stats.submitted, queue_stats.dispatched, queue_stats.merged,
+                queue_stats.bounced, queue_stats.max_depth);
+
+    host_printf("write-back: %u sectors written %u dirty, %u device writes carried %u sectors (%.1f per write)\n",
+                stats.writes, stats.dirty, stats.writebacks, stats.written_back,
+                stats.writebacks ? (double)stats.written_back / stats.writebacks : 0.0);
+
+    struct diskstreamer_stats streamer_stats;
+    diskstreamer_get_stats(&streamer_stats);
+    host_printf("read-ahead: %u sectors prefetched %u used (%.1f%%), window grew %u shrank %u times\n",
+                stats.prefetched, stats.prefetch_hits,
+                stats.prefetched ? stats.prefetch_hits * 100.0 / stats.prefetched : 0.0,
+                streamer_stats.window_grows, streamer_stats.window_shrinks);
+}
+
+//--------------------------------------------------------------------------------
+static void bench_alloc_pairs(const char* name, uint32_t min_size, uint32_t max_size, uint64_t total)
+{
+    uint64_t start = host_time_ns();
+
+    for(uint64_t i=0; i<total; i++)
+    {
+        void* ptr = kmalloc(min_size + host_random() % (max_size - min_size + 1));
+        kfree(ptr);
+    }
+
+    bench_report(name, total, start);
+}
+
+//--------------------------------------------------------------------------------
+static void bench_alloc_fill(const char* name, uint32_t max_size, int rounds)
+{
+    // keep many allocations live and free them in random order to fragment the heap
+    uint64_t start = host_time_ns();
+    uint64_t ops = 0;
+
+    for(int r=0; r<rounds; r++)
+    {
+        for(int i=0; i<BENCH_MAX_LIVE; i++)
+        {
+            live[i] = kmalloc(1 + host_random() % max_size);
+        }
+
+        for(int i=BENCH_MAX_LIVE-1; i>0; i--)
+        {
+            int j = host_random() % (i + 1);
+            void* tmp = live[i];
+            live[i] = live[j];
+            live[j] = tmp;
+        }
+
+        for(int i=0; i<BENCH_MAX_LIVE; i++)
+        {
+            kfree(live[i]);
+        }
+
+        ops += 2 * BENCH_MAX_LIVE;
+    }
+
+    bench_report(name, ops, start);
+}
+
+//--------------------------------------------------------------------------------
+static void bench_path_parse(uint64_t total)
+{
+    uint64_t start = host_time_ns();
+
+    for(uint64_t i=0; i<total; i++)
+    {
+        struct path_root* root = pathparser_parse(BENCH_NESTED_FILE, NULL);
+        pathparser_free(root);
+    }
+
+    bench_report("pathparser_parse + free", total, start);
+}
+
+//--------------------------------------------------------------------------------
+static void bench_open_close(uint64_t total)
+{
+    uint64_t start = host_time_ns();
+
+    for(uint64_t i=0; i<total; i++)
+    {
+        int fd = fopen(BENCH_NESTED_FILE, "r");
+        if(!fd)
+        {
+            host_printf("fopen %s failed\n", BENCH_NESTED_FILE);
+            return;
+        }
+        fclose(fd);
+    }
+
+    bench_report("fopen + fclose 0:/a/b/c.txt", total, start);
+}
+
+//--------------------------------------------------------------------------------
+static int bench_check_pattern(uint32_t offset, uint32_t size)
+{
+    for(uint32_t i=0; i<size; i++)
+    {
+        if((unsigned char)read_buffer[i] != (offset + i) % 251)
+        {
+            host_printf("data mismatch at file offset %u\n", offset + i);
+            return -EIO;
+        }
+    }
+
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+static int bench_read_at(int fd, uint32_t offset, uint32_t chunk)
+{
+    if(fseek(fd, offset, SEEK_SET) < 0 || fread(read_buffer, chunk, 1, fd) != 1)
+    {
+        host_printf("fread of %u bytes at %u failed\n", chunk, offset);
+        return -EIO;
+    }
+
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+static void bench_sequential_read(const char* name, int fd, uint32_t file_size, uint32_t chunk)
+{
+    uint64_t start = host_time_ns();
+    uint32_t offset = 0;
+
+    for(offset=0; offset + chunk <= file_size; offset += chunk)
+    {
+        if(bench_read_at(fd, offset, chunk) < 0 || (offset == 0 && bench_check_pattern(offset, chunk) < 0))
+        {
+            return;
+        }
+    }
+
+    bench_report_bytes(name, offset, start);
+}
+
+//--------------------------------------------------------------------------------
+static void bench_random_read(int fd, uint32_t file_size, uint32_t chunk, int total)
+{
+    uint64_t start = host_time_ns();
+
+    for(int i=0; i<total; i++)
+    {
+        uint32_t offset = (host_random() % (file_size / chunk)) * chunk;
+        if(bench_read_at(fd, offset, chunk) < 0 || bench_check_pattern(offset, chunk) < 0)
+        {
+            return;
+        }
+    }
+
+    bench_report_bytes("random fread 4 KB", (uint64_t)total * chunk, start);
+}
+
+//--------------------------------------------------------------------------------
+static int bench_check_file(const char* path, uint32_t file_size)
+{
+    // the whole file holds the pattern, and nothing more
+    int fd = fopen(path, "r");
+    if(!fd)
+    {
+        host_printf("fopen %s failed\n", path);
+        return -EIO;
+    }
+
+    struct file_stat stat;
+    fstat(fd, &stat);
+    if(stat.filesize != file_size)
+    {
+        host_printf("%s has %u bytes instead of %u\n", path, stat.filesize, file_size);
+        fclose(fd);
+        return -EIO;
+    }
+
+    for(uint32_t offset=0; offset < file_size; offset += 65536)
+    {
+        if(bench_read_at(fd, offset, 65536) < 0 || bench_check_pattern(offset, 65536) < 0)
+        {
+            fclose(fd);
+            return -EIO;
+        }
+    }
+
+    fclose(fd);
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+static int bench_write_file(const char* path, uint32_t file_size, uint32_t chunk)
+{
+    // "w" starts the file over, the writes only fill the cache and fflush pays for the disk
+    int fd = fopen(path, "w");
+    if(!fd)
+    {
+        host_printf("fopen %s for writing failed\n", path);
+        return -EIO;
+    }
+
+    uint64_t start = host_time_ns();
+    for(uint32_t offset=0; offset < file_size; offset += chunk)
+    {
+        for(uint32_t i=0; i<chunk; i++)
+        {
+            write_buffer[i] = (offset + i) % 251;
+        }
+
+        if(fwrite(write_buffer, chunk, 1, fd) != 1)
+        {
+            host_printf("fwrite of %u bytes at %u failed\n", chunk, offset);
+            fclose(fd);
+            return -EIO;
+        }
+    }
+    bench_report_bytes("sequential fwrite 4 KB", file_size, start);
+
+    start = host_time_ns();
+    int res = fflush(fd);
+    bench_report_bytes("fflush after it", file_size, start);
+    fclose(fd);
+
+    if(res < 0)
+    {
+        host_printf("fflush %s failed\n", path);
+        return res;
+    }
+
+    return bench_check_file(path, file_size);
+}
+
+//--------------------------------------------------------------------------------
+static int bench_big_file(const char* path)
+{
+    int fd = fopen(path, "r");
+    if(!fd)
+    {
+        host_printf("fopen %s failed\n", path);
+        return -EIO;
+    }
+
+    struct file_stat stat;
+    fstat(fd, &stat);
+
+    bench_sequential_read("sequential fread 4 KB", fd, stat.filesize, 4096);
+    bench_sequential_read("sequential fread 64 KB", fd, stat.filesize, 65536);
+    bench_sequential_read("sequential fread 256 KB", fd, stat.filesize, 262144);
+    bench_random_read(fd, stat.filesize, 4096, 2000);
+    fclose(fd);
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        host_printf("usage: %s <fat16 image> [heap megabytes]\n", argv[0]);
+        return 1;
+    }
+
+    size_t heap_megabytes = argc > 2 ? (size_t)tonumericdigit(argv[2][0]) : 0;
+    for(int i=1; argc > 2 && isdigit(argv[2][i]); i++)
+    {
+        heap_megabytes = heap_megabytes * 10 + tonumericdigit(argv[2][i]);
+    }
+    size_t heap_bytes = heap_megabytes ? heap_megabytes * 1024 * 1024 : CHUCHUOS_HEAP_SIZE_BYTES;
+
+    if(host_kheap_init(heap_bytes) < 0)
+    {
+        host_printf("could not create a %u byte heap\n", (unsigned)heap_bytes);
+        return 1;
+    }
+
+    fs_init();
+    if(host_disk_attach(argv[1]) < 0)
+    {
+        host_printf("%s is not a FAT16 image this kernel can read\n", argv[1]);
+        return 1;
+    }
+
+    bench_alloc_pairs("kmalloc/kfree 16-2048 bytes", 16, 2048, 2000000);
+    bench_alloc_pairs("kmalloc/kfree 4-64 KB", 4096, 65536, 1000000);
+    bench_alloc_fill("kmalloc fill/free <= 32 KB", 32768, 50);
+    bench_path_parse(500000);
+    bench_open_close(2000);
+
+    if(bench_big_file(BENCH_BIG_FILE) < 0)
+    {
+        return 1;
+    }
+
+    if(bench_write_file(BENCH_LOG_FILE, BENCH_LOG_FILE_SIZE, 4096) < 0)
+    {
+        return 1;
+    }
+    bench_print_bcache_stats();
+
+    // the file system alone, without the sector cache and the device in the way
+    if(host_ramdisk_attach(argv[1]) != 1)
+    {
+        host_printf("could not load %s into a ram disk\n", argv[1]);
+        return 1;
+    }
+
+    // the image was read back after the flush, so the log has to be in it
+    host_printf("ram disk:\n");
+    if(bench_check_file(BENCH_RAM_LOG_FILE, BENCH_LOG_FILE_SIZE) < 0 || bench_big_file(BENCH_RAM_BIG_FILE) < 0)
+    {
+        return 1;
+    }
+
+    if(bench_write_file(BENCH_RAM_LOG_FILE, BENCH_LOG_FILE_SIZE, 4096) < 0)
+    {
+        return 1;
+    }
+
+    disk_iostat_print_all();
+    kheap_print_stats();
+    return 0;
+}
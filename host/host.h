@@ -0,0 +1,26 @@
+#ifndef HOST_H
+#define HOST_H
+
+// Userspace shim for running kernel modules on a Linux host. This header must
+// stay free of libc includes, the kernel's fopen/fread/memcpy clash with them.
+
+#include <stdint.h>
+#include <stddef.h>
+
+// host_libc.c : the parts that need libc
+void* host_alloc_aligned(size_t alignment, size_t size);
+int host_image_open(const char* path);
+int host_image_read(int fd, void* buf, uint32_t size, uint64_t offset);
+int host_image_write(int fd, const void* buf, uint32_t size, uint64_t offset);
+int host_image_sync(int fd);
+uint64_t host_image_size(int fd);
+uint64_t host_time_ns();
+void host_printf(const char* fmt, ...);
+uint32_t host_random();
+
+// host_kernel.c : kernel entry points backed by the shim
+int host_kheap_init(size_t heap_bytes);
+int host_disk_attach(const char* image_path);
+int host_ramdisk_attach(const char* image_path);
+
+#endif
@@ -0,0 +1,130 @@
+#include "host.h"
+#include "config.h"
+#include "status.h"
+#include "disk/disk.h"
+#include "disk/ata.h"
+#include "time/timer.h"
+#include "memory/heap/kheap.h"
+#include "memory/memory.h"
+
+// Stands in for the disk drivers and the timer: the sectors of disk 0 come from an image file,
+// the other ata devices, the ahci controller and virtio block devices are missing
+
+static int disk_image_fd = -1;
+
+//--------------------------------------------------------------------------------
+int host_kheap_init(size_t heap_bytes)
+{
+    heap_bytes -= heap_bytes % CHUCHUOS_HEAP_BLOCK_SIZE;
+
+    void* saddr = host_alloc_aligned(CHUCHUOS_HEAP_BLOCK_SIZE,heap_bytes);
+    HEAP_BLOCK_TABLE_ENTRY* table = host_alloc_aligned(sizeof(void*),heap_bytes / CHUCHUOS_HEAP_BLOCK_SIZE);
+    if(!saddr || !table)
+    {
+        return -ENOMEM;
+    }
+
+    return kheap_init_region(saddr,saddr + heap_bytes,table);
+}
+
+//--------------------------------------------------------------------------------
+int host_disk_attach(const char* image_path)
+{
+    disk_image_fd = host_image_open(image_path);
+    if(disk_image_fd < 0)
+    {
+        return -EIO;
+    }
+
+    disk_search_and_init();
+
+    struct disk* disk = disk_get(0);
+    return disk && disk->filesystem ? 0 : -EFSNOTUS;
+}
+
+//--------------------------------------------------------------------------------
+int host_ramdisk_attach(const char* image_path)
+{
+    // the whole image in kernel heap memory as the next disk, returns its id
+    int fd = host_image_open(image_path);
+    if(fd < 0)
+    {
+        return -EIO;
+    }
+
+    unsigned int sectors = host_image_size(fd) / CHUCHUOS_SECTOR_SIZE;
+    void* data = kmalloc(sectors * CHUCHUOS_SECTOR_SIZE);
+    if(!data || host_image_read(fd,data,sectors * CHUCHUOS_SECTOR_SIZE,0) < 0)
+    {
+        return -ENOMEM;
+    }
+
+    struct disk* disk = disk_register_ramdisk(data,sectors);
+    if(!disk || !disk->filesystem)
+    {
+        return -EFSNOTUS;
+    }
+
+    return disk->id;
+}
+
+//--------------------------------------------------------------------------------
+int ata_probe(struct disk* disk, int index)
+{
+    if(index != 0)
+    {
+        return -EIO;
+    }
+
+    disk->read = ata_read_sectors;
+    disk->write = ata_write_sectors;
+    disk->flush = ata_flush_cache;
+    disk->sectors = host_image_size(disk_image_fd) / CHUCHUOS_SECTOR_SIZE;
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+int ata_read_sectors(struct disk* disk, unsigned int lba, int total, void* buf)
+{
+    if(host_image_read(disk_image_fd,buf,total * CHUCHUOS_SECTOR_SIZE,(uint64_t)lba * CHUCHUOS_SECTOR_SIZE) < 0)
+    {
+        return -EIO;
+    }
+
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+int ata_write_sectors(struct disk* disk, unsigned int lba, int total, const void* buf)
+{
+    if(host_image_write(disk_image_fd,buf,total * CHUCHUOS_SECTOR_SIZE,(uint64_t)lba * CHUCHUOS_SECTOR_SIZE) < 0)
+    {
+        return -EIO;
+    }
+
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+int ata_flush_cache(struct disk* disk)
+{
+    return host_image_sync(disk_image_fd) < 0 ? -EIO : 0;
+}
+
+//--------------------------------------------------------------------------------
+uint32_t timer_ticks()
+{
+    return host_time_ns() / (1000000000 / CHUCHUOS_TIMER_HZ);
+}
+
+//--------------------------------------------------------------------------------
+int ahci_probe(struct disk* disk, int index)
+{
+    return -EIO;
+}
+
+//--------------------------------------------------------------------------------
+int virtio_blk_probe(struct disk* disk, int index)
+{
+    return -EIO;
+}
@@ -0,0 +1,89 @@
+#define _GNU_SOURCE
+#include "host.h"
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+//--------------------------------------------------------------------------------
+void* host_alloc_aligned(size_t alignment, size_t size)
+{
+    void* ptr = 0;
+
+    if(posix_memalign(&ptr,alignment,size) != 0)
+    {
+        return 0;
+    }
+
+    return ptr;
+}
+
+//--------------------------------------------------------------------------------
+int host_image_open(const char* path)
+{
+    // the benchmark writes into its image, mkimage builds a fresh one for every run
+    return open(path,O_RDWR);
+}
+
+//--------------------------------------------------------------------------------
+int host_image_read(int fd, void* buf, uint32_t size, uint64_t offset)
+{
+    ssize_t res = pread(fd,buf,size,offset);
+    return res == (ssize_t)size ? 0 : -1;
+}
+
+//--------------------------------------------------------------------------------
+int host_image_write(int fd, const void* buf, uint32_t size, uint64_t offset)
+{
+    ssize_t res = pwrite(fd,buf,size,offset);
+    return res == (ssize_t)size ? 0 : -1;
+}
+
+//--------------------------------------------------------------------------------
+int host_image_sync(int fd)
+{
+    return fdatasync(fd);
+}
+
+//--------------------------------------------------------------------------------
+uint64_t host_image_size(int fd)
+{
+    off_t size = lseek(fd,0,SEEK_END);
+    return size < 0 ? 0 : size;
+}
+
+//--------------------------------------------------------------------------------
+uint64_t host_time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+//--------------------------------------------------------------------------------
+void host_printf(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args,fmt);
+    vprintf(fmt,args);
+    va_end(args);
+}
+
+//--------------------------------------------------------------------------------
+uint32_t host_random()
+{
+    // xorshift, so runs are repeatable and independent of libc's rand
+    static uint32_t state = 2463534242u;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+//--------------------------------------------------------------------------------
+void print(const char* str)
+{
+    fputs(str,stdout);
+}
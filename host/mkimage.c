@@ -0,0 +1,151 @@
+// Builds a small FAT16 image laid out like the one in src/boot/boot.asm, so the
+// host benchmark does not need mkfs or a loop mount.
+//
+//  0:/HELLO.TXT
+//  0:/A/B/C.TXT
+//  0:/BIG.BIN      BIG_FILE_SIZE bytes, byte n holds n % 251
+//  0:/LOG.BIN      empty, FREE_CLUSTERS clusters are left for it to grow into
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SECTOR_SIZE         512
+#define SECTORS_PER_CLUSTER 128
+#define RESERVED_SECTORS    200
+#define FAT_COPIES          2
+#define SECTORS_PER_FAT     256
+#define ROOT_DIR_ENTRIES    64
+#define CLUSTER_SIZE        (SECTOR_SIZE * SECTORS_PER_CLUSTER)
+
+#define BIG_FILE_SIZE       (8 * 1024 * 1024)
+#define BIG_FILE_CLUSTERS   (BIG_FILE_SIZE / CLUSTER_SIZE)
+#define FREE_CLUSTERS       64
+#define TOTAL_CLUSTERS      (4 + BIG_FILE_CLUSTERS + FREE_CLUSTERS)
+
+#define ROOT_DIR_SECTOR     (RESERVED_SECTORS + FAT_COPIES * SECTORS_PER_FAT)
+#define DATA_SECTOR         (ROOT_DIR_SECTOR + (ROOT_DIR_ENTRIES * 32) / SECTOR_SIZE)
+#define TOTAL_SECTORS       (DATA_SECTOR + TOTAL_CLUSTERS * SECTORS_PER_CLUSTER)
+
+static uint8_t* image;
+
+static void put16(uint8_t* p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+static void put32(uint8_t* p, uint32_t v) { put16(p, v); put16(p + 2, v >> 16); }
+
+static uint8_t* cluster_address(int cluster)
+{
+    return image + (DATA_SECTOR + (cluster - 2) * SECTORS_PER_CLUSTER) * SECTOR_SIZE;
+}
+
+static void set_fat(int cluster, uint16_t value)
+{
+    for(int copy = 0; copy < FAT_COPIES; copy++)
+    {
+        uint8_t* fat = image + (RESERVED_SECTORS + copy * SECTORS_PER_FAT) * SECTOR_SIZE;
+        put16(fat + cluster * 2, value);
+    }
+}
+
+static void set_chain(int first_cluster, int total_clusters)
+{
+    for(int i = 0; i < total_clusters; i++)
+    {
+        set_fat(first_cluster + i, i == total_clusters - 1 ? 0xFFFF : first_cluster + i + 1);
+    }
+}
+
+static void add_entry(uint8_t* dir, int index, const char* name, const char* ext, uint8_t attribute, int cluster, uint32_t size)
+{
+    uint8_t* entry = dir + index * 32;
+    memset(entry, ' ', 11);
+    memcpy(entry, name, strlen(name));
+    memcpy(entry + 8, ext, strlen(ext));
+    entry[11] = attribute;
+    put16(entry + 26, cluster);
+    put32(entry + 28, size);
+}
+
+int main(int argc, char** argv)
+{
+    if(argc != 2)
+    {
+        fprintf(stderr, "usage: %s <image>\n", argv[0]);
+        return 1;
+    }
+
+    size_t image_size = (size_t)TOTAL_SECTORS * SECTOR_SIZE;
+    image = calloc(1, image_size);
+    if(!image)
+    {
+        return 1;
+    }
+
+    // boot sector, same BPB as boot.asm apart from the volume size
+    uint8_t* bpb = image;
+    bpb[0] = 0xEB; bpb[1] = 0x3C; bpb[2] = 0x90;
+    memcpy(bpb + 3, "CHUCHUOS", 8);
+    put16(bpb + 11, SECTOR_SIZE);
+    bpb[13] = SECTORS_PER_CLUSTER;
+    put16(bpb + 14, RESERVED_SECTORS);
+    bpb[16] = FAT_COPIES;
+    put16(bpb + 17, ROOT_DIR_ENTRIES);
+    put16(bpb + 19, 0);
+    bpb[21] = 0xF8;
+    put16(bpb + 22, SECTORS_PER_FAT);
+    put16(bpb + 24, 0x20);
+    put16(bpb + 26, 0x40);
+    put32(bpb + 28, 0);
+    put32(bpb + 32, TOTAL_SECTORS);
+    bpb[36] = 0x80;
+    bpb[38] = 0x29;
+    put32(bpb + 39, 0xD105);
+    memcpy(bpb + 43, "CHUOS1 BOOT", 11);
+    memcpy(bpb + 54, "FAT16   ", 8);
+    bpb[510] = 0x55; bpb[511] = 0xAA;
+
+    set_fat(0, 0xFFF8);
+    set_fat(1, 0xFFFF);
+
+    static const char hello[] = "Hello from the host FAT16 image!\n";
+    static const char c_txt[] = "This is 0:/A/B/C.TXT\n";
+
+    uint8_t* root = image + ROOT_DIR_SECTOR * SECTOR_SIZE;
+    add_entry(root, 0, "HELLO", "TXT", 0x20, 2, sizeof(hello) - 1);
+    add_entry(root, 1, "A", "", 0x10, 3, 0);
+    add_entry(root, 2, "BIG", "BIN", 0x20, 6, BIG_FILE_SIZE);
+    add_entry(root, 3, "LOG", "BIN", 0x20, 0, 0);
+
+    memcpy(cluster_address(2), hello, sizeof(hello) - 1);
+    set_chain(2, 1);
+
+    add_entry(cluster_address(3), 0, ".", "", 0x10, 3, 0);
+    add_entry(cluster_address(3), 1, "..", "", 0x10, 0, 0);
+    add_entry(cluster_address(3), 2, "B", "", 0x10, 4, 0);
+    set_chain(3, 1);
+
+    add_entry(cluster_address(4), 0, ".", "", 0x10, 4, 0);
+    add_entry(cluster_address(4), 1, "..", "", 0x10, 3, 0);
+    add_entry(cluster_address(4), 2, "C", "TXT", 0x20, 5, sizeof(c_txt) - 1);
+    set_chain(4, 1);
+
+    memcpy(cluster_address(5), c_txt, sizeof(c_txt) - 1);
+    set_chain(5, 1);
+
+    uint8_t* big = cluster_address(6);
+    for(uint32_t i = 0; i < BIG_FILE_SIZE; i++)
+    {
+        big[i] = i % 251;
+    }
+    set_chain(6, BIG_FILE_CLUSTERS);
+
+    FILE* out = fopen(argv[1], "wb");
+    if(!out || fwrite(image, 1, image_size, out) != image_size)
+    {
+        fprintf(stderr, "could not write %s\n", argv[1]);
+        return 1;
+    }
+    fclose(out);
+    free(image);
+    return 0;
+}
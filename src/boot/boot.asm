@@ -6,6 +6,9 @@ BITS 16      ; need to boot in 16 bit mode, legacy booting
 CODE_SEG equ gdt_code - gdt_start  ; offset for Code Segment
 DATA_SEG equ gdt_data - gdt_start  ; offset for data segment
 
+E820_MAP equ 0x0500         ; must match CHUCHUOS_E820_MAP_ADDRESS in config.h
+E820_MAX_ENTRIES equ 128    ; must match CHUCHUOS_E820_MAX_ENTRIES in config.h
+
 ;Initially we are in real mode, where by default we have 16 bit instruction, and access to only 1mb of ram.
 jmp short start
 nop
@@ -50,6 +53,35 @@ step2:   ; we initialize all the segment register as a matter of good practice,
     mov sp, 0x7C00
     sti ; Enable interrupt
 
+; --> Ask the BIOS for the physical memory map while we still can (int 0x15, eax=0xE820).
+;     The kernel finds the number of entries at E820_MAP and the 24 byte entries right after it.
+.detect_memory:
+    mov di, E820_MAP + 4
+    xor ebx, ebx        ; continuation value, zero for the first call
+    xor bp, bp          ; number of entries stored
+.e820_next:
+    mov eax, 0xE820
+    mov edx, 0x534D4150 ; 'SMAP'
+    mov ecx, 24
+    mov dword [es:di+20], 1 ; valid ACPI 3.0 attributes, in case the BIOS returns only 20 bytes
+    int 0x15
+    jc .e820_done       ; carry is set on error or after the last entry
+    cmp eax, 0x534D4150
+    jne .e820_done
+    mov ecx, [es:di+8]  ; skip entries with zero length
+    or ecx, [es:di+12]
+    jz .e820_skip
+    inc bp
+    add di, 24
+.e820_skip:
+    test ebx, ebx       ; ebx = 0 means this was the last entry
+    jz .e820_done
+    cmp bp, E820_MAX_ENTRIES
+    jb .e820_next
+.e820_done:
+    mov [E820_MAP], bp
+    mov word [E820_MAP + 2], 0
+
 ; --> Now we are making preparation to switch to 32 bit mode
 .load_protected:
     cli  
@@ -97,7 +129,7 @@ gdt_descriptor:
 [BITS 32]
 load32:
     mov eax, 1 ; starting sector to load from, sector-1, bcz sector-0 contains our bootloader
-    mov ecx, 100 ; total no of sectors to load, remember in make file we dd'ed 100 sector of 512 bytes each
+    mov ecx, 199 ; total no of sectors to load, everything in front of the fat (200 reserved sectors minus this one)
     mov edi, 0x0100000   ; edi contains the address in the ram where the code needs to be loaded
     call ata_lba_read 
     ; so our disk driver has loaded the code from hard-disk to a specified ram address, see edi above.
@@ -6,14 +6,85 @@
 
 #define CHUCHUOS_TOTAL_INTERRUPTS 256
 
-//100 mb heap size
-#define CHUCHUOS_HEAP_SIZE_BYTES 104857600  // 100 mb in bytes
+// the heap starts here and grows on demand up to the end of the usable ram region
 #define CHUCHUOS_HEAP_BLOCK_SIZE    4096
 #define CHUCHUOS_HEAP_ADDRESS   0x01000000   // look at osdev memory map > 1mb
-#define CHUCHUOS_HEAP_TABLE_ADDRESS  0x00007E00 // 480.5 kb bytes free at this location, we need 25600 bytes
+#define CHUCHUOS_HEAP_INITIAL_SIZE  0x00800000  // 8 mb
+#define CHUCHUOS_HEAP_GROW_SIZE     0x00400000  // grow in steps of at least 4 mb
+//100 mb heap size, used only when the bios gave us no memory map (and by the host build)
+#define CHUCHUOS_HEAP_SIZE_BYTES 104857600  // 100 mb in bytes
+
+// boot.asm stores the bios e820 memory map here, below the bootloader at 0x7c00
+#define CHUCHUOS_E820_MAP_ADDRESS   0x00000500
+#define CHUCHUOS_E820_MAX_ENTRIES   128
+
+// one bit per 4 kb physical frame, 128 kb are enough for 4 gb
+#define CHUCHUOS_FRAME_SIZE     4096
+#define CHUCHUOS_FRAME_BITMAP_ADDRESS   0x00020000
+#define CHUCHUOS_KERNEL_RESERVED_END    0x00200000  // bios area, kernel image and kernel stack
+
+// kmalloc serves requests up to this size from slab caches, one cache per power of two
+#define CHUCHUOS_SLAB_MIN_SIZE  16
+#define CHUCHUOS_SLAB_MAX_SIZE  2048
+#define CHUCHUOS_SLAB_MIN_OBJECTS   8   // a slab grows to more heap blocks until this many objects fit
+
+// set to 1 to record caller, size and timestamp of every kmalloc/kfree
+#define CHUCHUOS_KHEAP_PROFILE  0
+#define CHUCHUOS_KHEAP_PROFILE_MAX_LIVE    1024    // outstanding allocations tracked at once
+#define CHUCHUOS_KHEAP_PROFILE_MAX_SITES   64      // distinct kmalloc call sites tracked
 
 
+// identity map the kernel with 4mb pages when the cpu supports PSE
+#define CHUCHUOS_PAGING_LARGE_PAGES 1
+// build only the page directory and map the rest from the page fault handler
+#define CHUCHUOS_PAGING_DEMAND  1
+// ranges up to this many pages are flushed with invlpg, bigger ones reload cr3
+#define CHUCHUOS_PAGING_INVLPG_MAX_PAGES    32
+// set to 1 to measure paging costs at boot, see paging_bench.c
+#define CHUCHUOS_PAGING_BENCHMARK   0
+
 #define CHUCHUOS_SECTOR_SIZE 512
+#define CHUCHUOS_MAX_DISKS  8   // drive numbers of paths are a single digit
+// image loaded into a ram disk at boot, it gets the first drive number after the real disks
+#define CHUCHUOS_INITRD 1
+#define CHUCHUOS_INITRD_PATH    "0:/initrd.img"
+// reads of a disk whose driver sets no limit of its own, and the size of the bounce buffers
+#define CHUCHUOS_DISK_MAX_SECTORS_PER_READ  256
+// sleep on irq 14 while the disk works instead of polling its status port
+#define CHUCHUOS_ATA_USE_IRQ    1
+// move pio data with rep insw instead of one insw per word
+#define CHUCHUOS_ATA_STRING_IO  1
+// let the ide controller write sectors into memory itself, needs CHUCHUOS_ATA_USE_IRQ
+#define CHUCHUOS_ATA_USE_DMA    1
+// set to 1 to compare pio data paths and dma throughput at boot, see ata_bench.c
+#define CHUCHUOS_ATA_BENCHMARK  0
+// set to 1 to compare virtio-blk with ata pio reads at boot, see virtio_blk_bench.c
+#define CHUCHUOS_VIRTIO_BENCHMARK   0
+
+// memory the sector cache may use for sector data, and its hash buckets (a power of two)
+#define CHUCHUOS_BCACHE_SIZE_BYTES  262144  // 256 kb
+#define CHUCHUOS_BCACHE_HASH_BUCKETS    256
+// reads of at least this many sectors are bulk data, they go to the caller without being cached
+#define CHUCHUOS_BCACHE_BYPASS_SECTORS  32
+// read-ahead window of a sequentially read disk stream, it doubles on every sequential read
+#define CHUCHUOS_READAHEAD_MIN_SECTORS  8
+#define CHUCHUOS_READAHEAD_MAX_SECTORS  64
+// writes only dirty the cache, dirty sectors reach the disk when evicted, on a flush, once
+// the oldest of them has waited this long, or when there are more of them than the limit
+#define CHUCHUOS_BCACHE_WRITEBACK_MS    5000
+#define CHUCHUOS_BCACHE_DIRTY_MAX_SECTORS   256
+// adjacent dirty sectors are written back together, up to this many with one disk write
+#define CHUCHUOS_BCACHE_WRITEBACK_MAX_SECTORS   64
+
+// a resolved fat16 volume keeps its file allocation table in memory, tables of more sectors
+// than this are not read at once but a sector at a time as their entries are first needed
+#define CHUCHUOS_FAT16_FAT_PRELOAD_MAX_SECTORS  256
+
+// set to 1 to print the i/o counters and latency histograms of every disk once the kernel is up
+#define CHUCHUOS_DISK_IOSTAT_DUMP   0
+
+// rate of the timer interrupt
+#define CHUCHUOS_TIMER_HZ   100
 
 #define CHUCHUOS_MAX_FILESYSTEMS 12
 #define CHUCHUOS_MAX_FILE_DESCRIPTORS 512
@@ -0,0 +1,542 @@
+#include "ahci.h"
+#include "disk.h"
+#include "config.h"
+#include "status.h"
+#include "pci/pci.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+#include "memory/frame/frame.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Serial ata disks behind an ahci host bus adapter. Every port has 32 command slots, with
+// native command queuing the drive works on all of them at once and reorders them itself.
+// Completion is polled, the hba interrupt stays masked.
+
+#define AHCI_CAP_NCS_SHIFT  8       // bits 8-12, command slots minus one
+#define AHCI_CAP_NCS_MASK   0x1f
+#define AHCI_CAP_SNCQ       (1 << 30)
+
+#define AHCI_GHC_AE         (1 << 31)   // ahci mode instead of the legacy task file interface
+
+#define AHCI_PORT_CMD_ST    (1 << 0)    // process the command list
+#define AHCI_PORT_CMD_FRE   (1 << 4)    // receive fises
+#define AHCI_PORT_CMD_FR    (1 << 14)
+#define AHCI_PORT_CMD_CR    (1 << 15)
+
+#define AHCI_PORT_IS_TFES   (1 << 30)   // task file error, the drive failed a command
+
+#define AHCI_PORT_SSTS_DET_MASK     0x0f
+#define AHCI_PORT_SSTS_DET_PRESENT  0x03    // device detected and phy communication established
+
+#define AHCI_PORT_SIG_ATA   0x00000101
+
+#define AHCI_TFD_DRQ        (1 << 3)
+#define AHCI_TFD_BSY        (1 << 7)
+
+#define AHCI_FIS_TYPE_REG_H2D   0x27
+#define AHCI_FIS_COMMAND        (1 << 7)    // the fis carries a command, not a device control update
+#define AHCI_DEVICE_LBA         (1 << 6)
+
+#define AHCI_COMMAND_READ_DMA_EXT       0x25
+#define AHCI_COMMAND_READ_FPDMA_QUEUED  0x60
+#define AHCI_COMMAND_IDENTIFY           0xEC
+
+// words of the identify data
+#define AHCI_IDENTIFY_QUEUE_DEPTH       75  // bits 0-4, depth minus one
+#define AHCI_IDENTIFY_SATA_CAPABILITIES 76
+#define AHCI_IDENTIFY_SATA_NCQ          (1 << 8)
+#define AHCI_IDENTIFY_LBA28_SECTORS     60  // two words
+#define AHCI_IDENTIFY_COMMAND_SETS      83
+#define AHCI_IDENTIFY_LBA48             (1 << 10)
+#define AHCI_IDENTIFY_LBA48_SECTORS     100 // four words
+
+#define AHCI_PRDT_ENTRIES   8
+#define AHCI_PRD_MAX_BYTES  0x400000    // 4 mb, the byte count field holds 22 bits
+#define AHCI_MAX_SECTORS    65536       // the 16 bit count of the ext commands, fills all prd entries
+
+// One physical region of a command, the address must be word aligned
+struct ahci_prd
+{
+    uint32_t dba;
+    uint32_t dbau;
+    uint32_t reserved;
+    uint32_t dbc;       // bits 0-21 byte count minus one, bit 31 interrupt on completion
+} __attribute__((packed));
+
+// What the hba sends to the drive for one command slot, 128 byte aligned
+struct ahci_command_table
+{
+    uint8_t cfis[64];
+    uint8_t acmd[16];
+    uint8_t reserved[48];
+    struct ahci_prd prdt[AHCI_PRDT_ENTRIES];
+} __attribute__((packed));
+
+// One entry of the 32 entry command list of a port
+struct ahci_command_header
+{
+    uint16_t flags;     // bits 0-4 fis length in dwords, bit 6 write
+    uint16_t prdtl;
+    volatile uint32_t prdbc;
+    uint32_t ctba;
+    uint32_t ctbau;
+    uint32_t reserved[4];
+} __attribute__((packed));
+
+// Register host to device fis
+struct ahci_fis_h2d
+{
+    uint8_t type;
+    uint8_t flags;
+    uint8_t command;
+    uint8_t feature_low;
+    uint8_t lba0;
+    uint8_t lba1;
+    uint8_t lba2;
+    uint8_t device;
+    uint8_t lba3;
+    uint8_t lba4;
+    uint8_t lba5;
+    uint8_t feature_high;
+    uint8_t count_low;
+    uint8_t count_high;
+    uint8_t icc;
+    uint8_t control;
+    uint32_t reserved;
+} __attribute__((packed));
+
+// A port with a drive on it, disk->driver_private points at it
+struct ahci_port
+{
+    volatile struct ahci_port_registers* registers;
+    struct ahci_command_header* command_list;
+    struct ahci_command_table* command_tables;  // one per slot
+
+    bool ncq;
+    int queue_depth;        // slots in use at most
+    uint32_t busy_slots;    // issued and not yet seen completed
+    int status;             // the first error since the last ahci_complete
+
+    unsigned int sectors;
+    char* bounce;           // for buffers the hba cannot address, allocated on first use
+};
+
+static volatile struct ahci_hba_registers* ahci_hba = 0;
+static int ahci_command_slots = 0;
+static bool ahci_hba_ncq = false;
+static bool ahci_initialized = false;
+
+static struct ahci_port ahci_ports[AHCI_MAX_PORTS];
+
+//--------------------------------------------------------------------------------
+static void ahci_barrier()
+{
+    // the command list and tables must be in memory before the hba is told about them
+    asm volatile("" ::: "memory");
+}
+
+//--------------------------------------------------------------------------------
+static void ahci_port_stop(volatile struct ahci_port_registers* registers)
+{
+    registers->cmd &= ~AHCI_PORT_CMD_ST;
+    while(registers->cmd & AHCI_PORT_CMD_CR)
+    {
+    }
+
+    registers->cmd &= ~AHCI_PORT_CMD_FRE;
+    while(registers->cmd & AHCI_PORT_CMD_FR)
+    {
+    }
+}
+
+//--------------------------------------------------------------------------------
+static void ahci_port_start(volatile struct ahci_port_registers* registers)
+{
+    while(registers->cmd & AHCI_PORT_CMD_CR)
+    {
+    }
+
+    registers->serr = 0xffffffff;
+    registers->is = 0xffffffff;
+
+    registers->cmd |= AHCI_PORT_CMD_FRE;
+    registers->cmd |= AHCI_PORT_CMD_ST;
+}
+
+//--------------------------------------------------------------------------------
+static void ahci_init()
+{
+    struct pci_device device;
+    ahci_initialized = true;
+
+    for(int i = 0; pci_find_class(PCI_CLASS_MASS_STORAGE, PCI_SUBCLASS_SATA, i, &device) == 0; i++)
+    {
+        if(device.prog_if != PCI_PROG_IF_AHCI)
+        {
+            continue;
+        }
+
+        // bar 5 is the memory mapped abar, the whole 4gb is identity mapped so it is used as is
+        uint32_t bar = pci_get_bar(&device, 5);
+        if(bar & PCI_BAR_IO)
+        {
+            continue;
+        }
+
+        pci_enable_bus_master(&device);
+
+        ahci_hba = (struct ahci_hba_registers*)(bar & PCI_BAR_MEMORY_MASK);
+        ahci_hba->ghc |= AHCI_GHC_AE;
+
+        ahci_command_slots = ((ahci_hba->cap >> AHCI_CAP_NCS_SHIFT) & AHCI_CAP_NCS_MASK) + 1;
+        ahci_hba_ncq = (ahci_hba->cap & AHCI_CAP_SNCQ) != 0;
+        return;
+    }
+}
+
+//--------------------------------------------------------------------------------
+static int ahci_port_init(struct ahci_port* port, volatile struct ahci_port_registers* registers)
+{
+    // one frame holds the 1 kb command list and the 256 byte received fis area behind it
+    void* frame = frame_alloc();
+    void* tables = frame_alloc_contiguous((AHCI_MAX_SLOTS * sizeof(struct ahci_command_table) + CHUCHUOS_FRAME_SIZE - 1) / CHUCHUOS_FRAME_SIZE);
+    if(!frame || !tables)
+    {
+        return -ENOMEM;
+    }
+
+    memset(frame, 0, CHUCHUOS_FRAME_SIZE);
+    memset(tables, 0, AHCI_MAX_SLOTS * sizeof(struct ahci_command_table));
+
+    port->registers = registers;
+    port->command_list = frame;
+    port->command_tables = tables;
+
+    ahci_port_stop(registers);
+
+    registers->clb = (uint32_t)port->command_list;
+    registers->clbu = 0;
+    registers->fb = (uint32_t)frame + (AHCI_MAX_SLOTS * sizeof(struct ahci_command_header));
+    registers->fbu = 0;
+    registers->ie = 0;
+
+    for(int slot = 0; slot < AHCI_MAX_SLOTS; slot++)
+    {
+        port->command_list[slot].ctba = (uint32_t)&port->command_tables[slot];
+        port->command_list[slot].ctbau = 0;
+    }
+
+    ahci_port_start(registers);
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+static int ahci_build_command(struct ahci_port* port, int slot, unsigned char command, unsigned int lba, int total, void* buf)
+{
+    // kernel memory is identity mapped, so buf is also the address the hba needs
+    struct ahci_command_header* header = &port->command_list[slot];
+    struct ahci_command_table* table = &port->command_tables[slot];
+    uint32_t address = (uint32_t)buf;
+    uint32_t bytes = total * CHUCHUOS_SECTOR_SIZE;
+    int i = 0;
+
+    while(bytes > 0)
+    {
+        if(i == AHCI_PRDT_ENTRIES)
+        {
+            return -EINVARG;
+        }
+
+        uint32_t count = bytes > AHCI_PRD_MAX_BYTES ? AHCI_PRD_MAX_BYTES : bytes;
+        table->prdt[i].dba = address;
+        table->prdt[i].dbau = 0;
+        table->prdt[i].dbc = count - 1;
+
+        address += count;
+        bytes -= count;
+        i++;
+    }
+
+    struct ahci_fis_h2d* fis = (struct ahci_fis_h2d*)table->cfis;
+    memset(fis, 0, sizeof(struct ahci_fis_h2d));
+    fis->type = AHCI_FIS_TYPE_REG_H2D;
+    fis->flags = AHCI_FIS_COMMAND;
+    fis->command = command;
+    fis->device = AHCI_DEVICE_LBA;
+    fis->lba0 = lba & 0xff;
+    fis->lba1 = (lba >> 8) & 0xff;
+    fis->lba2 = (lba >> 16) & 0xff;
+    fis->lba3 = (lba >> 24) & 0xff;
+
+    if(command == AHCI_COMMAND_READ_FPDMA_QUEUED)
+    {
+        // the sector count moves to the feature registers, the count register holds the tag
+        fis->feature_low = total & 0xff;
+        fis->feature_high = (total >> 8) & 0xff;
+        fis->count_low = slot << 3;
+    }
+    else
+    {
+        fis->count_low = total & 0xff;
+        fis->count_high = (total >> 8) & 0xff;
+    }
+
+    header->flags = sizeof(struct ahci_fis_h2d) / sizeof(uint32_t);
+    header->prdtl = i;
+    header->prdbc = 0;
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+static void ahci_port_recover(struct ahci_port* port)
+{
+    // a failed command stops the port, every command still in flight is lost with it
+    ahci_port_stop(port->registers);
+    ahci_port_start(port->registers);
+
+    port->busy_slots = 0;
+    port->status = -EIO;
+}
+
+//--------------------------------------------------------------------------------
+static void ahci_reap(struct ahci_port* port)
+{
+    // waits until at least one busy slot has completed
+    uint32_t busy = port->busy_slots;
+
+    while(port->busy_slots == busy)
+    {
+        if(port->registers->is & AHCI_PORT_IS_TFES)
+        {
+            ahci_port_recover(port);
+            return;
+        }
+
+        port->busy_slots &= port->registers->ci | port->registers->sact;
+    }
+}
+
+//--------------------------------------------------------------------------------
+static int ahci_issue(struct ahci_port* port, unsigned char command, unsigned int lba, int total, void* buf)
+{
+    // waits for a free slot when all of them are in flight, returns once the command is issued
+    uint32_t depth_mask = port->queue_depth == 32 ? 0xffffffff : (1 << port->queue_depth) - 1;
+
+    while((port->busy_slots & depth_mask) == depth_mask)
+    {
+        ahci_reap(port);
+    }
+
+    int slot = 0;
+    while(port->busy_slots & (1 << slot))
+    {
+        slot++;
+    }
+
+    int res = ahci_build_command(port, slot, command, lba, total, buf);
+    if(res < 0)
+    {
+        return res;
+    }
+
+    ahci_barrier();
+
+    port->busy_slots |= 1 << slot;
+    if(command == AHCI_COMMAND_READ_FPDMA_QUEUED)
+    {
+        port->registers->sact = 1 << slot;
+    }
+    port->registers->ci = 1 << slot;
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+static int ahci_wait_all(struct ahci_port* port)
+{
+    while(port->busy_slots)
+    {
+        ahci_reap(port);
+    }
+
+    int res = port->status;
+    port->status = 0;
+    return res;
+}
+
+//--------------------------------------------------------------------------------
+static int ahci_identify(struct ahci_port* port, unsigned short* identify)
+{
+    while(port->registers->tfd & (AHCI_TFD_BSY | AHCI_TFD_DRQ))
+    {
+    }
+
+    int res = ahci_issue(port, AHCI_COMMAND_IDENTIFY, 0, 1, identify);
+    if(res < 0)
+    {
+        return res;
+    }
+
+    return ahci_wait_all(port);
+}
+
+//--------------------------------------------------------------------------------
+int ahci_probe(struct disk* disk, int index)
+{
+    // index is the port number on the first ahci hba
+    int res = 0;
+    unsigned short* identify = 0;
+
+    if(!ahci_initialized)
+    {
+        ahci_init();
+    }
+
+    if(!ahci_hba || index < 0 || index >= AHCI_MAX_PORTS || !(ahci_hba->pi & (1 << index)))
+    {
+        return -EIO;
+    }
+
+    volatile struct ahci_port_registers* registers = &ahci_hba->ports[index];
+    if((registers->ssts & AHCI_PORT_SSTS_DET_MASK) != AHCI_PORT_SSTS_DET_PRESENT || registers->sig != AHCI_PORT_SIG_ATA)
+    {
+        return -EIO;
+    }
+
+    struct ahci_port* port = &ahci_ports[index];
+    res = ahci_port_init(port, registers);
+    if(res < 0)
+    {
+        goto out;
+    }
+
+    // the hba writes the identify data straight into it
+    identify = kzalloc(CHUCHUOS_SECTOR_SIZE);
+    if(!identify)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    port->queue_depth = 1;
+    res = ahci_identify(port, identify);
+    if(res < 0)
+    {
+        goto out;
+    }
+
+    if(identify[AHCI_IDENTIFY_COMMAND_SETS] & AHCI_IDENTIFY_LBA48)
+    {
+        // the 32 bit lbas of struct disk reach 2 tb, bigger drives are cut there
+        port->sectors = identify[AHCI_IDENTIFY_LBA48_SECTORS] | ((uint32_t)identify[AHCI_IDENTIFY_LBA48_SECTORS+1] << 16);
+        if(identify[AHCI_IDENTIFY_LBA48_SECTORS+2] || identify[AHCI_IDENTIFY_LBA48_SECTORS+3])
+        {
+            port->sectors = 0xffffffff;
+        }
+    }
+    else
+    {
+        port->sectors = identify[AHCI_IDENTIFY_LBA28_SECTORS] | ((uint32_t)identify[AHCI_IDENTIFY_LBA28_SECTORS+1] << 16);
+    }
+
+    port->ncq = ahci_hba_ncq && (identify[AHCI_IDENTIFY_SATA_CAPABILITIES] & AHCI_IDENTIFY_SATA_NCQ);
+    if(port->ncq)
+    {
+        port->queue_depth = (identify[AHCI_IDENTIFY_QUEUE_DEPTH] & 0x1f) + 1;
+    }
+    else
+    {
+        // the slots still pipeline commands without ncq, the drive just runs them in order
+        port->queue_depth = ahci_command_slots;
+    }
+
+    if(port->queue_depth > ahci_command_slots)
+    {
+        port->queue_depth = ahci_command_slots;
+    }
+
+    disk->read = ahci_read_sectors;
+    disk->submit = ahci_submit;
+    disk->complete = ahci_complete;
+    disk->sectors = port->sectors;
+    disk->max_sectors = AHCI_MAX_SECTORS;
+    disk->driver_private = port;
+
+out:
+    if(identify)
+    {
+        kfree(identify);
+    }
+    return res;
+}
+
+//--------------------------------------------------------------------------------
+int ahci_submit(struct disk* disk, unsigned int lba, int total, void* buf)
+{
+    // returns as soon as the read is issued, ahci_complete waits for it
+    struct ahci_port* port = disk->driver_private;
+
+    if((uint32_t)buf & 1)
+    {
+        // the hba only addresses words, such a read is done on its own through the bounce buffer
+        return ahci_read_sectors(disk, lba, total, buf);
+    }
+
+    return ahci_issue(port, port->ncq ? AHCI_COMMAND_READ_FPDMA_QUEUED : AHCI_COMMAND_READ_DMA_EXT, lba, total, buf);
+}
+
+//--------------------------------------------------------------------------------
+int ahci_complete(struct disk* disk)
+{
+    return ahci_wait_all(disk->driver_private);
+}
+
+//--------------------------------------------------------------------------------
+int ahci_read_sectors(struct disk* disk, unsigned int lba, int total, void* buf)
+{
+    struct ahci_port* port = disk->driver_private;
+    int res = 0;
+
+    if(!((uint32_t)buf & 1))
+    {
+        res = ahci_submit(disk, lba, total, buf);
+        if(res < 0)
+        {
+            return res;
+        }
+
+        return ahci_complete(disk);
+    }
+
+    if(!port->bounce)
+    {
+        port->bounce = kmalloc(CHUCHUOS_DISK_MAX_SECTORS_PER_READ * CHUCHUOS_SECTOR_SIZE);
+        if(!port->bounce)
+        {
+            return -ENOMEM;
+        }
+    }
+
+    while(total > 0)
+    {
+        int count = total > CHUCHUOS_DISK_MAX_SECTORS_PER_READ ? CHUCHUOS_DISK_MAX_SECTORS_PER_READ : total;
+
+        res = ahci_submit(disk, lba, count, port->bounce);
+        if(res == 0)
+        {
+            res = ahci_complete(disk);
+        }
+
+        if(res < 0)
+        {
+            return res;
+        }
+
+        memcpy(buf, port->bounce, count * CHUCHUOS_SECTOR_SIZE);
+        lba += count;
+        total -= count;
+        buf += count * CHUCHUOS_SECTOR_SIZE;
+    }
+
+    return 0;
+}
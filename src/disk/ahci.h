@@ -0,0 +1,59 @@
+#ifndef AHCI_H
+#define AHCI_H
+
+#include <stdint.h>
+
+#define AHCI_MAX_PORTS  32
+#define AHCI_MAX_SLOTS  32  // command slots of a port, also the deepest ncq queue
+
+struct disk;
+
+// The registers of one port, mapped at 0x100 + port * 0x80 of the hba memory
+struct ahci_port_registers
+{
+    uint32_t clb;       // command list base, 1 kb aligned
+    uint32_t clbu;
+    uint32_t fb;        // received fis base, 256 byte aligned
+    uint32_t fbu;
+    uint32_t is;        // interrupt status, bits are cleared by writing a 1
+    uint32_t ie;
+    uint32_t cmd;
+    uint32_t reserved0;
+    uint32_t tfd;       // task file data, the ata status and error registers
+    uint32_t sig;
+    uint32_t ssts;
+    uint32_t sctl;
+    uint32_t serr;
+    uint32_t sact;      // ncq slots the drive still works on
+    uint32_t ci;        // slots issued to the hba
+    uint32_t sntf;
+    uint32_t fbs;
+    uint32_t reserved1[11];
+    uint32_t vendor[4];
+} __attribute__((packed));
+
+// The generic host control registers, at the address in bar 5 of the hba
+struct ahci_hba_registers
+{
+    uint32_t cap;
+    uint32_t ghc;
+    uint32_t is;
+    uint32_t pi;        // bit n is set when port n is implemented
+    uint32_t vs;
+    uint32_t ccc_ctl;
+    uint32_t ccc_ports;
+    uint32_t em_loc;
+    uint32_t em_ctl;
+    uint32_t cap2;
+    uint32_t bohc;
+    uint8_t reserved[0xA0 - 0x2C];
+    uint8_t vendor[0x100 - 0xA0];
+    struct ahci_port_registers ports[AHCI_MAX_PORTS];
+} __attribute__((packed));
+
+int ahci_probe(struct disk* disk, int index);
+int ahci_read_sectors(struct disk* disk, unsigned int lba, int total, void* buf);
+int ahci_submit(struct disk* disk, unsigned int lba, int total, void* buf);
+int ahci_complete(struct disk* disk);
+
+#endif
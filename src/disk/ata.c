@@ -0,0 +1,763 @@
+#include "ata.h"
+#include "disk.h"
+#include "config.h"
+#include "status.h"
+#include "io/io.h"
+#include "idt/idt.h"
+#include "pci/pci.h"
+#include "memory/frame/frame.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// PIO and bus master DMA transfers on both legacy ata channels, master and slave on each.
+// Writes take the same paths the other way round, FLUSH CACHE empties the drive's write cache
+
+// task file registers, relative to the io base of a channel
+#define ATA_REG_DATA            0
+#define ATA_REG_SECTOR_COUNT    2
+#define ATA_REG_LBA_LOW         3
+#define ATA_REG_LBA_MID         4
+#define ATA_REG_LBA_HIGH        5
+#define ATA_REG_DRIVE           6
+#define ATA_REG_STATUS          7
+#define ATA_REG_COMMAND         7
+
+#define ATA_STATUS_ERR  (1 << 0)
+#define ATA_STATUS_DRQ  (1 << 3)    // the drive has a sector ready in its data port
+#define ATA_STATUS_DF   (1 << 5)
+#define ATA_STATUS_BSY  (1 << 7)
+
+#define ATA_COMMAND_READ_SECTORS    0x20
+#define ATA_COMMAND_READ_SECTORS_EXT    0x24
+#define ATA_COMMAND_READ_DMA        0xC8
+#define ATA_COMMAND_READ_DMA_EXT    0x25
+#define ATA_COMMAND_WRITE_SECTORS   0x30
+#define ATA_COMMAND_WRITE_SECTORS_EXT   0x34
+#define ATA_COMMAND_WRITE_DMA       0xCA
+#define ATA_COMMAND_WRITE_DMA_EXT   0x35
+#define ATA_COMMAND_FLUSH_CACHE     0xE7
+#define ATA_COMMAND_FLUSH_CACHE_EXT 0xEA
+#define ATA_COMMAND_IDENTIFY        0xEC
+
+// words of the identify data
+#define ATA_IDENTIFY_LBA28_SECTORS  60  // two words
+#define ATA_IDENTIFY_COMMAND_SETS   83
+#define ATA_IDENTIFY_LBA48          (1 << 10)
+#define ATA_IDENTIFY_LBA48_SECTORS  100 // four words
+
+// what a command with a 28 bit lba and an 8 bit sector count reaches, 48 bit ones take 16 bits
+#define ATA_LBA28_LIMIT         0x0FFFFFFF
+#define ATA_LBA28_MAX_SECTORS   256
+#define ATA_LBA48_MAX_SECTORS   65536
+
+// status polls before a probed drive is given up on, a missing drive may never clear bsy
+#define ATA_PROBE_TIMEOUT   100000
+
+// bus master registers of a channel, relative to bar 4 of the ide controller plus 8 per channel
+#define ATA_BM_COMMAND  0x00
+#define ATA_BM_STATUS   0x02
+#define ATA_BM_PRDT     0x04
+#define ATA_BM_CHANNEL_STRIDE   8
+
+#define ATA_BM_COMMAND_START    (1 << 0)
+#define ATA_BM_COMMAND_READ     (1 << 3)    // the controller writes into memory
+#define ATA_BM_STATUS_ERROR     (1 << 1)
+#define ATA_BM_STATUS_IRQ       (1 << 2)    // both status bits are cleared by writing a 1
+
+#define ATA_PRD_END_OF_TABLE    0x8000
+#define ATA_PRD_MAX_ENTRIES     (CHUCHUOS_FRAME_SIZE / sizeof(struct ata_prd))
+
+// One physical region the controller transfers into, it must not cross a 64 kb boundary
+struct ata_prd
+{
+    uint32_t address;
+    uint16_t byte_count;    // 0 means 64 kb
+    uint16_t flags;
+} __attribute__((packed));
+
+// The command in flight on a channel while the cpu sleeps, the irq handler moves its sectors
+struct ata_request
+{
+    volatile bool pending;
+    bool dma;
+    bool write;
+    volatile int status;
+    unsigned short* buf;
+    int remaining;  // sectors the drive still has to deliver or accept, 0 for commands without data
+};
+
+// A channel runs one command at a time for either of its drives, the two channels are
+// independent and each has its own irq, so both can have a command in flight
+struct ata_channel
+{
+    unsigned short io_base;
+    unsigned short control_base;    // device control on write, alternate status on read
+    unsigned short bm_base;         // io base of the bus master registers, 0 without dma
+    struct ata_prd* prd_table;
+    int selected_drive;             // the drive the last command went to, -1 before the first
+
+    struct ata_request request;
+};
+
+// A drive found by ata_probe, disk->driver_private points at it
+struct ata_device
+{
+    struct ata_channel* channel;
+    int drive;      // 0 master, 1 slave
+    bool lba48;     // understands the ext commands
+    unsigned int sectors;
+};
+
+static struct ata_channel ata_channels[ATA_TOTAL_CHANNELS] =
+{
+    { .io_base = 0x1F0, .control_base = 0x3F6, .selected_drive = -1 },    // primary, irq 14
+    { .io_base = 0x170, .control_base = 0x376, .selected_drive = -1 },    // secondary, irq 15
+};
+
+static struct ata_device ata_devices[ATA_TOTAL_DEVICES];
+static bool ata_irq_enabled = false;
+
+static bool ata_string_io = CHUCHUOS_ATA_STRING_IO;
+
+//--------------------------------------------------------------------------------
+static void ata_read_data(struct ata_channel* channel, unsigned short* ptr)
+{
+    // Copy one sector from hard disk to memory
+    if(ata_string_io)
+    {
+        insw_rep(channel->io_base + ATA_REG_DATA, ptr, 256);
+        return;
+    }
+
+    for (int i = 0; i < 256; i++)
+    {
+        *ptr = insw(channel->io_base + ATA_REG_DATA);
+        ptr++;
+    }
+}
+
+//--------------------------------------------------------------------------------
+static void ata_write_data(struct ata_channel* channel, const unsigned short* ptr)
+{
+    // Copy one sector from memory to hard disk
+    if(ata_string_io)
+    {
+        outsw_rep(channel->io_base + ATA_REG_DATA, ptr, 256);
+        return;
+    }
+
+    for (int i = 0; i < 256; i++)
+    {
+        outw(channel->io_base + ATA_REG_DATA, *ptr);
+        ptr++;
+    }
+}
+
+//--------------------------------------------------------------------------------
+static void ata_delay_400ns(struct ata_channel* channel)
+{
+    // each read of the alternate status takes ~100ns
+    for(int i = 0; i < 4; i++)
+    {
+        insb(channel->control_base);
+    }
+}
+
+//--------------------------------------------------------------------------------
+static int ata_wait_data_request(struct ata_channel* channel)
+{
+    // until the drive is ready to move the next sector, the status is only valid without bsy
+    unsigned char status = insb(channel->io_base + ATA_REG_STATUS);
+    while((status & ATA_STATUS_BSY) || !(status & ATA_STATUS_DRQ))
+    {
+        if(!(status & ATA_STATUS_BSY) && (status & (ATA_STATUS_ERR | ATA_STATUS_DF)))
+        {
+            return -EIO;
+        }
+
+        status = insb(channel->io_base + ATA_REG_STATUS);
+    }
+
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+static int ata_wait_idle(struct ata_channel* channel)
+{
+    // no timeout, a flush of the drive's write cache may take seconds
+    unsigned char status = insb(channel->io_base + ATA_REG_STATUS);
+    while(status & ATA_STATUS_BSY)
+    {
+        status = insb(channel->io_base + ATA_REG_STATUS);
+    }
+
+    return (status & (ATA_STATUS_ERR | ATA_STATUS_DF)) ? -EIO : 0;
+}
+
+//--------------------------------------------------------------------------------
+static void ata_select(struct ata_channel* channel, int drive, unsigned int lba)
+{
+    outb(channel->io_base + ATA_REG_DRIVE, 0xE0 | (drive << 4) | ((lba >> 24) & 0x0f));
+
+    if(channel->selected_drive != drive)
+    {
+        // the other drive needs 400ns to put its status on the bus
+        ata_delay_400ns(channel);
+        channel->selected_drive = drive;
+    }
+}
+
+//--------------------------------------------------------------------------------
+static void ata_issue(struct ata_device* device, unsigned int lba, int total, unsigned char command, unsigned char command_ext)
+{
+    // the short 28 bit form whenever the request fits into it
+    unsigned short io_base = device->channel->io_base;
+
+    if(total <= ATA_LBA28_MAX_SECTORS && lba <= ATA_LBA28_LIMIT - total)
+    {
+        ata_select(device->channel, device->drive, lba);
+        outb(io_base + ATA_REG_SECTOR_COUNT, (unsigned char)total);   // 256 sectors are sent as 0
+        outb(io_base + ATA_REG_LBA_LOW, (unsigned char)(lba & 0xff));
+        outb(io_base + ATA_REG_LBA_MID, (unsigned char)(lba >> 8));
+        outb(io_base + ATA_REG_LBA_HIGH, (unsigned char)(lba >> 16));
+        outb(io_base + ATA_REG_COMMAND, command);
+        return;
+    }
+
+    // every register takes two writes, the high order byte goes first. 65536 sectors are sent as 0
+    ata_select(device->channel, device->drive, 0);
+    outb(io_base + ATA_REG_SECTOR_COUNT, (unsigned char)(total >> 8));
+    outb(io_base + ATA_REG_LBA_LOW, (unsigned char)(lba >> 24));
+    outb(io_base + ATA_REG_LBA_MID, 0);     // lba bits 32-47, struct disk addresses 32 bits
+    outb(io_base + ATA_REG_LBA_HIGH, 0);
+    outb(io_base + ATA_REG_SECTOR_COUNT, (unsigned char)total);
+    outb(io_base + ATA_REG_LBA_LOW, (unsigned char)(lba & 0xff));
+    outb(io_base + ATA_REG_LBA_MID, (unsigned char)(lba >> 8));
+    outb(io_base + ATA_REG_LBA_HIGH, (unsigned char)(lba >> 16));
+    outb(io_base + ATA_REG_COMMAND, command_ext);
+}
+
+//--------------------------------------------------------------------------------
+static int ata_read_sectors_polling(struct ata_device* device, unsigned int lba, int total, void* buf)
+{
+    struct ata_channel* channel = device->channel;
+
+    ata_issue(device, lba, total, ATA_COMMAND_READ_SECTORS, ATA_COMMAND_READ_SECTORS_EXT);
+
+    unsigned short* ptr = (unsigned short*) buf;
+    for (int b = 0; b < total; b++)
+    {
+        // the status of the previous sector may still show drq for 400ns
+        ata_delay_400ns(channel);
+        if(ata_wait_data_request(channel) < 0)
+        {
+            return -EIO;
+        }
+
+        ata_read_data(channel, ptr);
+        ptr += 256;
+    }
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+static void ata_request_start(struct ata_channel* channel, void* buf, int total, bool dma, bool write)
+{
+    // called with interrupts disabled, before the command goes to the drive
+    channel->request.buf = buf;
+    channel->request.remaining = total;
+    channel->request.status = 0;
+    channel->request.dma = dma;
+    channel->request.write = write;
+    channel->request.pending = true;
+}
+
+//--------------------------------------------------------------------------------
+static int ata_request_wait(struct ata_channel* channel)
+{
+    // only this channel's request is waited for, the irq of the other one is served meanwhile
+    while(channel->request.pending)
+    {
+        wait_for_interrupt();
+        disable_interrupts();
+    }
+
+    enable_interrupts();
+    return channel->request.status;
+}
+
+//--------------------------------------------------------------------------------
+static int ata_read_sectors_irq(struct ata_device* device, unsigned int lba, int total, void* buf)
+{
+    // the drive raises its channel's irq once per sector, the handler drains it while we sleep
+    disable_interrupts();
+
+    ata_request_start(device->channel, buf, total, false, false);
+    ata_issue(device, lba, total, ATA_COMMAND_READ_SECTORS, ATA_COMMAND_READ_SECTORS_EXT);
+
+    return ata_request_wait(device->channel);
+}
+
+//--------------------------------------------------------------------------------
+static int ata_build_prd_table(struct ata_channel* channel, void* buf, uint32_t bytes)
+{
+    // kernel memory is identity mapped, so the virtual address of buf is also the one the
+    // controller needs, and heap buffers are physically contiguous
+    uint32_t address = (uint32_t)buf;
+    int i = 0;
+
+    while(bytes > 0)
+    {
+        if(i == ATA_PRD_MAX_ENTRIES)
+        {
+            return -EINVARG;
+        }
+
+        uint32_t count = 0x10000 - (address & 0xffff);
+        if(count > bytes)
+        {
+            count = bytes;
+        }
+
+        channel->prd_table[i].address = address;
+        channel->prd_table[i].byte_count = count & 0xffff;
+        channel->prd_table[i].flags = 0;
+
+        address += count;
+        bytes -= count;
+        i++;
+    }
+
+    channel->prd_table[i-1].flags = ATA_PRD_END_OF_TABLE;
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+static int ata_transfer_dma(struct disk* disk, unsigned int lba, int total, void* buf, bool write)
+{
+    // the controller moves the sectors between the drive and buf and raises the irq when done
+    int res = 0;
+    struct ata_device* device = disk->driver_private;
+    struct ata_channel* channel = device->channel;
+
+    if(!channel->bm_base || !ata_irq_enabled || ((uint32_t)buf & 1))
+    {
+        return -EUNIMP;
+    }
+
+    res = ata_build_prd_table(channel, buf, total * CHUCHUOS_SECTOR_SIZE);
+    if(res < 0)
+    {
+        return res;
+    }
+
+    unsigned char direction = write ? 0 : ATA_BM_COMMAND_READ;
+
+    disable_interrupts();
+
+    outl(channel->bm_base + ATA_BM_PRDT, (uint32_t)channel->prd_table);
+    outb(channel->bm_base + ATA_BM_COMMAND, direction);
+    outb(channel->bm_base + ATA_BM_STATUS, insb(channel->bm_base + ATA_BM_STATUS) | ATA_BM_STATUS_ERROR | ATA_BM_STATUS_IRQ);
+
+    ata_request_start(channel, buf, total, true, write);
+    if(write)
+    {
+        ata_issue(device, lba, total, ATA_COMMAND_WRITE_DMA, ATA_COMMAND_WRITE_DMA_EXT);
+    }
+    else
+    {
+        ata_issue(device, lba, total, ATA_COMMAND_READ_DMA, ATA_COMMAND_READ_DMA_EXT);
+    }
+    outb(channel->bm_base + ATA_BM_COMMAND, direction | ATA_BM_COMMAND_START);
+
+    return ata_request_wait(channel);
+}
+
+//--------------------------------------------------------------------------------
+int ata_read_sectors_dma(struct disk* disk, unsigned int lba, int total, void* buf)
+{
+    return ata_transfer_dma(disk, lba, total, buf, false);
+}
+
+//--------------------------------------------------------------------------------
+int ata_read_sectors_pio(struct disk* disk, unsigned int lba, int total, void* buf)
+{
+    struct ata_device* device = disk->driver_private;
+
+    if(ata_irq_enabled)
+    {
+        return ata_read_sectors_irq(device, lba, total, buf);
+    }
+
+    return ata_read_sectors_polling(device, lba, total, buf);
+}
+
+//--------------------------------------------------------------------------------
+int ata_read_sectors(struct disk* disk, unsigned int lba, int total, void* buf)
+{
+#if CHUCHUOS_ATA_USE_DMA
+    // pio stays the fallback, for odd buffers, before interrupts are on, for lba48 reads too
+    // scattered for one prd table and on dma errors
+    if(ata_read_sectors_dma(disk, lba, total, buf) == 0)
+    {
+        return 0;
+    }
+#endif
+
+    return ata_read_sectors_pio(disk, lba, total, buf);
+}
+
+//--------------------------------------------------------------------------------
+static int ata_write_sectors_polling(struct ata_device* device, unsigned int lba, int total, const void* buf)
+{
+    struct ata_channel* channel = device->channel;
+
+    ata_issue(device, lba, total, ATA_COMMAND_WRITE_SECTORS, ATA_COMMAND_WRITE_SECTORS_EXT);
+
+    const unsigned short* ptr = buf;
+    for (int b = 0; b < total; b++)
+    {
+        ata_delay_400ns(channel);
+        if(ata_wait_data_request(channel) < 0)
+        {
+            return -EIO;
+        }
+
+        ata_write_data(channel, ptr);
+        ptr += 256;
+    }
+
+    // the last sector is only written once bsy drops again
+    ata_delay_400ns(channel);
+    return ata_wait_idle(channel);
+}
+
+//--------------------------------------------------------------------------------
+static int ata_write_sectors_irq(struct ata_device* device, unsigned int lba, int total, const void* buf)
+{
+    // the first sector goes out right away, the irq after each sector asks for the next one
+    struct ata_channel* channel = device->channel;
+
+    disable_interrupts();
+
+    ata_request_start(channel, (void*)buf, total, false, true);
+    ata_issue(device, lba, total, ATA_COMMAND_WRITE_SECTORS, ATA_COMMAND_WRITE_SECTORS_EXT);
+
+    ata_delay_400ns(channel);
+    if(ata_wait_data_request(channel) < 0)
+    {
+        channel->request.pending = false;
+        enable_interrupts();
+        return -EIO;
+    }
+
+    ata_write_data(channel, channel->request.buf);
+    channel->request.buf += 256;
+
+    return ata_request_wait(channel);
+}
+
+//--------------------------------------------------------------------------------
+int ata_write_sectors(struct disk* disk, unsigned int lba, int total, const void* buf)
+{
+    struct ata_device* device = disk->driver_private;
+
+#if CHUCHUOS_ATA_USE_DMA
+    if(ata_transfer_dma(disk, lba, total, (void*)buf, true) == 0)
+    {
+        return 0;
+    }
+#endif
+
+    if(ata_irq_enabled)
+    {
+        return ata_write_sectors_irq(device, lba, total, buf);
+    }
+
+    return ata_write_sectors_polling(device, lba, total, buf);
+}
+
+//--------------------------------------------------------------------------------
+int ata_flush_cache(struct disk* disk)
+{
+    // returns once every sector the drive took so far is on the medium
+    struct ata_device* device = disk->driver_private;
+    struct ata_channel* channel = device->channel;
+    unsigned char command = device->lba48 ? ATA_COMMAND_FLUSH_CACHE_EXT : ATA_COMMAND_FLUSH_CACHE;
+
+    if(!ata_irq_enabled)
+    {
+        ata_select(channel, device->drive, 0);
+        outb(channel->io_base + ATA_REG_COMMAND, command);
+        ata_delay_400ns(channel);
+        return ata_wait_idle(channel);
+    }
+
+    disable_interrupts();
+
+    ata_request_start(channel, 0, 0, false, false);
+    ata_select(channel, device->drive, 0);
+    outb(channel->io_base + ATA_REG_COMMAND, command);
+
+    return ata_request_wait(channel);
+}
+
+//--------------------------------------------------------------------------------
+static int ata_wait_not_busy(struct ata_channel* channel)
+{
+    for(int i = 0; i < ATA_PROBE_TIMEOUT; i++)
+    {
+        unsigned char status = insb(channel->io_base + ATA_REG_STATUS);
+        if(!(status & ATA_STATUS_BSY))
+        {
+            return status;
+        }
+    }
+
+    return -EIO;
+}
+
+//--------------------------------------------------------------------------------
+static int ata_identify(struct ata_channel* channel, int drive, unsigned short* identify)
+{
+    // polled, the probe runs before interrupts are enabled
+    ata_select(channel, drive, 0);
+    outb(channel->io_base + ATA_REG_SECTOR_COUNT, 0);
+    outb(channel->io_base + ATA_REG_LBA_LOW, 0);
+    outb(channel->io_base + ATA_REG_LBA_MID, 0);
+    outb(channel->io_base + ATA_REG_LBA_HIGH, 0);
+    outb(channel->io_base + ATA_REG_COMMAND, ATA_COMMAND_IDENTIFY);
+
+    // nothing drives the bus without a drive, it reads as 0 or as all ones on a missing channel
+    unsigned char status = insb(channel->io_base + ATA_REG_STATUS);
+    if(status == 0 || status == 0xff)
+    {
+        return -EIO;
+    }
+
+    int res = ata_wait_not_busy(channel);
+    if(res < 0)
+    {
+        return res;
+    }
+
+    // atapi and sata drives identify themselves here and abort the command
+    if(insb(channel->io_base + ATA_REG_LBA_MID) || insb(channel->io_base + ATA_REG_LBA_HIGH))
+    {
+        return -EIO;
+    }
+
+    status = res;
+    while(!(status & ATA_STATUS_DRQ))
+    {
+        if(status & (ATA_STATUS_ERR | ATA_STATUS_DF))
+        {
+            return -EIO;
+        }
+
+        status = insb(channel->io_base + ATA_REG_STATUS);
+    }
+
+    ata_read_data(channel, identify);
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+int ata_probe(struct disk* disk, int index)
+{
+    // index 0 is the primary master, the drive the kernel was loaded from
+    unsigned short identify[256];
+
+    if(index < 0 || index >= ATA_TOTAL_DEVICES)
+    {
+        return -EINVARG;
+    }
+
+    struct ata_channel* channel = &ata_channels[index / 2];
+    int drive = index % 2;
+    int res = ata_identify(channel, drive, identify);
+    if(res < 0)
+    {
+        return res;
+    }
+
+    struct ata_device* device = &ata_devices[index];
+    device->channel = channel;
+    device->drive = drive;
+    device->lba48 = (identify[ATA_IDENTIFY_COMMAND_SETS] & ATA_IDENTIFY_LBA48) != 0;
+
+    if(device->lba48)
+    {
+        // the 32 bit lbas of struct disk reach 2 tb, bigger drives are cut there
+        device->sectors = identify[ATA_IDENTIFY_LBA48_SECTORS] | ((uint32_t)identify[ATA_IDENTIFY_LBA48_SECTORS+1] << 16);
+        if(identify[ATA_IDENTIFY_LBA48_SECTORS+2] || identify[ATA_IDENTIFY_LBA48_SECTORS+3])
+        {
+            device->sectors = 0xffffffff;
+        }
+    }
+    else
+    {
+        device->sectors = identify[ATA_IDENTIFY_LBA28_SECTORS] | ((uint32_t)identify[ATA_IDENTIFY_LBA28_SECTORS+1] << 16);
+    }
+
+    disk->read = ata_read_sectors;
+    disk->write = ata_write_sectors;
+    disk->flush = ata_flush_cache;
+    disk->sectors = device->sectors;
+    disk->max_sectors = device->lba48 ? ATA_LBA48_MAX_SECTORS : ATA_LBA28_MAX_SECTORS;
+    disk->driver_private = device;
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+static void ata_dma_init()
+{
+    struct pci_device device;
+
+    if(pci_find_class(PCI_CLASS_MASS_STORAGE, PCI_SUBCLASS_IDE, 0, &device) < 0)
+    {
+        return;
+    }
+
+    // bar 4 holds the bus master registers, 8 ports for each channel
+    uint32_t bar = pci_get_bar(&device, 4);
+    if(!(bar & PCI_BAR_IO) || !(bar & 0xfffc))
+    {
+        return;
+    }
+
+    for(int i = 0; i < ATA_TOTAL_CHANNELS; i++)
+    {
+        // a single frame is 4 kb aligned, so the table never crosses a 64 kb boundary either
+        ata_channels[i].prd_table = frame_alloc();
+        if(!ata_channels[i].prd_table)
+        {
+            return;
+        }
+
+        ata_channels[i].bm_base = (bar & 0xfffc) + (i * ATA_BM_CHANNEL_STRIDE);
+    }
+
+    pci_enable_bus_master(&device);
+}
+
+//--------------------------------------------------------------------------------
+void ata_set_string_io(bool enabled)
+{
+    ata_string_io = enabled;
+}
+
+//--------------------------------------------------------------------------------
+bool ata_dma_available()
+{
+    return ata_channels[0].bm_base != 0;
+}
+
+//--------------------------------------------------------------------------------
+void ata_enable_irq()
+{
+    // only once the idt is loaded and interrupts are on, the disks are polled until then
+#if CHUCHUOS_ATA_USE_IRQ
+    for(int i = 0; i < ATA_TOTAL_CHANNELS; i++)
+    {
+        // device control register, clearing nIEN lets the drives raise the channel's irq
+        outb(ata_channels[i].control_base, 0x00);
+    }
+    ata_irq_enabled = true;
+
+    // dma completion is only signalled by interrupt
+    ata_dma_init();
+#endif
+}
+
+//--------------------------------------------------------------------------------
+static void ata_handle_dma_interrupt(struct ata_channel* channel)
+{
+    unsigned char bm_status = insb(channel->bm_base + ATA_BM_STATUS);
+    unsigned char status = insb(channel->io_base + ATA_REG_STATUS);
+
+    if(!(bm_status & ATA_BM_STATUS_IRQ))
+    {
+        return;
+    }
+
+    outb(channel->bm_base + ATA_BM_COMMAND, 0);
+    outb(channel->bm_base + ATA_BM_STATUS, bm_status | ATA_BM_STATUS_ERROR | ATA_BM_STATUS_IRQ);
+
+    if((bm_status & ATA_BM_STATUS_ERROR) || (status & (ATA_STATUS_ERR | ATA_STATUS_DF)))
+    {
+        channel->request.status = -EIO;
+    }
+
+    channel->request.remaining = 0;
+    channel->request.pending = false;
+}
+
+//--------------------------------------------------------------------------------
+void ata_handle_interrupt(int channel_no)
+{
+    struct ata_channel* channel = &ata_channels[channel_no];
+    struct ata_request* request = &channel->request;
+
+    if(request->pending && request->dma)
+    {
+        ata_handle_dma_interrupt(channel);
+        return;
+    }
+
+    // reading the status register also acknowledges the interrupt on the drive
+    unsigned char status = insb(channel->io_base + ATA_REG_STATUS);
+
+    if(!request->pending)
+    {
+        return;
+    }
+
+    if(status & (ATA_STATUS_ERR | ATA_STATUS_DF))
+    {
+        request->status = -EIO;
+        request->pending = false;
+        return;
+    }
+
+    if(request->remaining == 0)
+    {
+        // a command without data, e.g. a cache flush, is done with its only irq
+        request->pending = false;
+        return;
+    }
+
+    if(request->write)
+    {
+        // each irq acknowledges a sector, drq asks for the next one
+        if(request->remaining > 1 && !(status & ATA_STATUS_DRQ))
+        {
+            return;
+        }
+
+        request->remaining--;
+        if(request->remaining == 0)
+        {
+            request->pending = false;
+            return;
+        }
+
+        ata_write_data(channel, request->buf);
+        request->buf += 256;
+        return;
+    }
+
+    if(!(status & ATA_STATUS_DRQ))
+    {
+        return;
+    }
+
+    ata_read_data(channel, request->buf);
+    request->buf += 256;
+    request->remaining--;
+
+    if(request->remaining == 0)
+    {
+        request->pending = false;
+    }
+}
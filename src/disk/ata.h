@@ -0,0 +1,23 @@
+#ifndef ATA_H
+#define ATA_H
+
+#include <stdbool.h>
+
+// primary and secondary channel, a master and a slave on each
+#define ATA_TOTAL_CHANNELS  2
+#define ATA_TOTAL_DEVICES   4
+
+struct disk;
+
+int ata_probe(struct disk* disk, int index);
+int ata_read_sectors(struct disk* disk, unsigned int lba, int total, void* buf);
+int ata_read_sectors_pio(struct disk* disk, unsigned int lba, int total, void* buf);
+int ata_read_sectors_dma(struct disk* disk, unsigned int lba, int total, void* buf);
+int ata_write_sectors(struct disk* disk, unsigned int lba, int total, const void* buf);
+int ata_flush_cache(struct disk* disk);
+bool ata_dma_available();
+void ata_set_string_io(bool enabled);
+void ata_enable_irq();
+void ata_handle_interrupt(int channel_no);
+
+#endif
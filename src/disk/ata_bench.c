@@ -0,0 +1,72 @@
+#include "ata_bench.h"
+#include "ata.h"
+#include "config.h"
+#include "kernel.h"
+#include "memory/heap/kheap.h"
+#include "string/string.h"
+#include "time/tsc.h"
+
+// sectors read per measurement, and per request
+#define ATA_BENCH_TOTAL_SECTORS     4096
+#define ATA_BENCH_REQUEST_SECTORS   128
+
+typedef int (*ATA_BENCH_READ_FUNCTION)(struct disk* disk, unsigned int lba, int total, void* buf);
+
+//------------------------------------------------------------------------------------------------
+static void ata_bench_print(const char* label, uint32_t value)
+{
+    char buf[33];
+
+    print(label);
+    print(itoa(value,buf,10));
+    print("\n");
+}
+
+//------------------------------------------------------------------------------------------------
+static uint32_t ata_bench_read(struct disk* disk, ATA_BENCH_READ_FUNCTION read, void* buffer)
+{
+    // the same sectors for both paths, the disk caches them after the first pass
+    uint64_t start = tsc_read();
+
+    for(int lba=0; lba<ATA_BENCH_TOTAL_SECTORS; lba+=ATA_BENCH_REQUEST_SECTORS)
+    {
+        if(read(disk,lba,ATA_BENCH_REQUEST_SECTORS,buffer) < 0)
+        {
+            return 0;
+        }
+    }
+
+    return (tsc_read() - start) / ATA_BENCH_TOTAL_SECTORS;
+}
+
+//------------------------------------------------------------------------------------------------
+void ata_benchmark(struct disk* disk)
+{
+    void* buffer = kmalloc(ATA_BENCH_REQUEST_SECTORS * CHUCHUOS_SECTOR_SIZE);
+    if(!buffer)
+    {
+        return;
+    }
+
+    // the data phase one word at a time and with rep insw
+    ata_set_string_io(false);
+    ata_bench_read(disk,ata_read_sectors_pio,buffer);
+    ata_bench_print("ata: pio insw loop cycles/sector: ",ata_bench_read(disk,ata_read_sectors_pio,buffer));
+
+    ata_set_string_io(true);
+    ata_bench_read(disk,ata_read_sectors_pio,buffer);
+    ata_bench_print("ata: pio rep insw cycles/sector: ",ata_bench_read(disk,ata_read_sectors_pio,buffer));
+
+    if(ata_dma_available())
+    {
+        ata_bench_read(disk,ata_read_sectors_dma,buffer);
+        ata_bench_print("ata: dma cycles/sector: ",ata_bench_read(disk,ata_read_sectors_dma,buffer));
+    }
+    else
+    {
+        print("ata: no bus master dma controller\n");
+    }
+
+    ata_set_string_io(CHUCHUOS_ATA_STRING_IO);
+    kfree(buffer);
+}
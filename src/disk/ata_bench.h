@@ -0,0 +1,8 @@
+#ifndef ATA_BENCH_H
+#define ATA_BENCH_H
+
+#include "disk.h"
+
+void ata_benchmark(struct disk* disk);
+
+#endif
@@ -0,0 +1,499 @@
+#include "bcache.h"
+#include "disk.h"
+#include "status.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+#include "time/timer.h"
+
+#define BCACHE_MAX_BUFFERS  (CHUCHUOS_BCACHE_SIZE_BYTES / CHUCHUOS_SECTOR_SIZE)
+
+static struct bcache_buffer* bcache_hash[CHUCHUOS_BCACHE_HASH_BUCKETS];
+static struct bcache_buffer* bcache_lru_head = 0;   // most recently used
+static struct bcache_buffer* bcache_lru_tail = 0;   // next to be evicted
+static struct slab_cache* bcache_buffer_cache = 0;
+static char* bcache_prefetch_buffer = 0;    // CHUCHUOS_READAHEAD_MAX_SECTORS sectors, allocated on first use
+static char* bcache_writeback_buffer = 0;   // CHUCHUOS_BCACHE_WRITEBACK_MAX_SECTORS sectors, allocated on first use
+static uint32_t bcache_dirty_since = 0;     // timer tick at which the oldest dirty sector was written
+static struct bcache_stats bcache_stats;
+
+//--------------------------------------------------------------------------------
+static uint32_t bcache_bucket(struct disk* disk, unsigned int lba)
+{
+    // consecutive sectors land in consecutive buckets
+    return (lba + (disk->id * 31)) & (CHUCHUOS_BCACHE_HASH_BUCKETS - 1);
+}
+
+//--------------------------------------------------------------------------------
+static void bcache_lru_remove(struct bcache_buffer* buffer)
+{
+    if(buffer->lru_prev)
+    {
+        buffer->lru_prev->lru_next = buffer->lru_next;
+    }
+    else
+    {
+        bcache_lru_head = buffer->lru_next;
+    }
+
+    if(buffer->lru_next)
+    {
+        buffer->lru_next->lru_prev = buffer->lru_prev;
+    }
+    else
+    {
+        bcache_lru_tail = buffer->lru_prev;
+    }
+
+    buffer->lru_next = 0;
+    buffer->lru_prev = 0;
+}
+
+//--------------------------------------------------------------------------------
+static void bcache_lru_push(struct bcache_buffer* buffer)
+{
+    buffer->lru_prev = 0;
+    buffer->lru_next = bcache_lru_head;
+
+    if(bcache_lru_head)
+    {
+        bcache_lru_head->lru_prev = buffer;
+    }
+    else
+    {
+        bcache_lru_tail = buffer;
+    }
+
+    bcache_lru_head = buffer;
+}
+
+//--------------------------------------------------------------------------------
+static void bcache_hash_remove(struct bcache_buffer* buffer)
+{
+    struct bcache_buffer** link = &bcache_hash[bcache_bucket(buffer->disk,buffer->lba)];
+
+    while(*link && *link != buffer)
+    {
+        link = &(*link)->hash_next;
+    }
+
+    if(*link)
+    {
+        *link = buffer->hash_next;
+    }
+
+    buffer->hash_next = 0;
+}
+
+//--------------------------------------------------------------------------------
+static struct bcache_buffer* bcache_lookup(struct disk* disk, unsigned int lba)
+{
+    struct bcache_buffer* buffer = bcache_hash[bcache_bucket(disk,lba)];
+
+    while(buffer && (buffer->disk != disk || buffer->lba != lba))
+    {
+        buffer = buffer->hash_next;
+    }
+
+    return buffer;
+}
+
+//--------------------------------------------------------------------------------
+static bool bcache_is_dirty(struct disk* disk, unsigned int lba)
+{
+    struct bcache_buffer* buffer = bcache_lookup(disk,lba);
+    return buffer && buffer->dirty;
+}
+
+//--------------------------------------------------------------------------------
+static int bcache_writeback(struct bcache_buffer* buffer)
+{
+    // the dirty neighbours go out with it, the whole run takes a single disk write
+    int res = 0;
+    struct disk* disk = buffer->disk;
+    unsigned int max_run = CHUCHUOS_BCACHE_WRITEBACK_MAX_SECTORS;
+    unsigned int first = buffer->lba;
+    unsigned int run = 0;
+
+    if(max_run > disk->max_sectors)
+    {
+        max_run = disk->max_sectors;
+    }
+
+    if(!bcache_writeback_buffer)
+    {
+        bcache_writeback_buffer = kmalloc(CHUCHUOS_BCACHE_WRITEBACK_MAX_SECTORS * CHUCHUOS_SECTOR_SIZE);
+    }
+
+    if(!bcache_writeback_buffer)
+    {
+        // no memory to gather a run in, the sector goes out on its own
+        res = disk_device_write(disk,buffer->lba,1,buffer->data);
+        run = 1;
+        goto out;
+    }
+
+    while(first > 0 && buffer->lba - first < max_run - 1 && bcache_is_dirty(disk,first-1))
+    {
+        first--;
+    }
+
+    while(run < max_run && bcache_is_dirty(disk,first+run))
+    {
+        memcpy(bcache_writeback_buffer + (run * CHUCHUOS_SECTOR_SIZE),bcache_lookup(disk,first+run)->data,CHUCHUOS_SECTOR_SIZE);
+        run++;
+    }
+
+    res = disk_device_write(disk,first,run,bcache_writeback_buffer);
+
+out:
+    if(res < 0)
+    {
+        return res;
+    }
+
+    for(unsigned int i=0; i<run; i++)
+    {
+        bcache_lookup(disk,first+i)->dirty = false;
+    }
+
+    bcache_stats.dirty -= run;
+    bcache_stats.writebacks++;
+    bcache_stats.written_back += run;
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+static struct bcache_buffer* bcache_get_free_buffer()
+{
+    // a new buffer while the budget allows it, otherwise the least recently used clean one
+    struct bcache_buffer* buffer = 0;
+
+    if(bcache_stats.total_buffers < BCACHE_MAX_BUFFERS)
+    {
+        buffer = kcache_zalloc(bcache_buffer_cache);
+        if(buffer)
+        {
+            bcache_stats.total_buffers++;
+            return buffer;
+        }
+    }
+
+    // dirty buffers are written back before they are reused, the ones the disk refuses stay
+    buffer = bcache_lru_tail;
+    while(buffer && buffer->dirty && bcache_writeback(buffer) < 0)
+    {
+        buffer = buffer->lru_prev;
+    }
+
+    if(buffer)
+    {
+        bcache_lru_remove(buffer);
+        bcache_hash_remove(buffer);
+        bcache_stats.evictions++;
+    }
+
+    return buffer;
+}
+
+//--------------------------------------------------------------------------------
+static struct bcache_buffer* bcache_insert(struct disk* disk, unsigned int lba, const void* data, bool prefetched)
+{
+    struct bcache_buffer* buffer = bcache_get_free_buffer();
+    if(!buffer)
+    {
+        // out of memory, the read itself still succeeded
+        return 0;
+    }
+
+    buffer->disk = disk;
+    buffer->lba = lba;
+    buffer->prefetched = prefetched;
+    buffer->dirty = false;
+    memcpy(buffer->data,(void*)data,CHUCHUOS_SECTOR_SIZE);
+
+    uint32_t bucket = bcache_bucket(disk,lba);
+    buffer->hash_next = bcache_hash[bucket];
+    bcache_hash[bucket] = buffer;
+
+    bcache_lru_push(buffer);
+    return buffer;
+}
+
+//--------------------------------------------------------------------------------
+void bcache_init()
+{
+    if(bcache_buffer_cache)
+    {
+        return;
+    }
+
+    memset(bcache_hash,0,sizeof(bcache_hash));
+    memset(&bcache_stats,0,sizeof(bcache_stats));
+    bcache_stats.max_buffers = BCACHE_MAX_BUFFERS;
+    bcache_buffer_cache = kcache_create("bcache",sizeof(struct bcache_buffer));
+}
+
+//--------------------------------------------------------------------------------
+int bcache_read(struct disk* disk, unsigned int lba, int total, void* buf)
+{
+    int res = 0;
+    char* out = buf;
+    int i = 0;
+
+    if(!bcache_buffer_cache)
+    {
+        return disk_device_read(disk,lba,total,buf);
+    }
+
+    while(i < total)
+    {
+        struct bcache_buffer* buffer = bcache_lookup(disk,lba+i);
+        if(buffer)
+        {
+            memcpy(out + (i * CHUCHUOS_SECTOR_SIZE),buffer->data,CHUCHUOS_SECTOR_SIZE);
+            bcache_lru_remove(buffer);
+            bcache_lru_push(buffer);
+            bcache_stats.hits++;
+
+            if(buffer->prefetched)
+            {
+                buffer->prefetched = false;
+                bcache_stats.prefetch_hits++;
+            }
+            i++;
+            continue;
+        }
+
+        // every sector up to the next cached one is fetched with a single disk request
+        int run = 1;
+        while(i + run < total && !bcache_lookup(disk,lba+i+run))
+        {
+            run++;
+        }
+
+        res = disk_device_read(disk,lba+i,run,out + (i * CHUCHUOS_SECTOR_SIZE));
+        if(res < 0)
+        {
+            goto out;
+        }
+
+        bcache_stats.misses += run;
+        bcache_stats.device_reads++;
+
+        // bulk reads would only push the metadata out of the cache
+        if(total < CHUCHUOS_BCACHE_BYPASS_SECTORS)
+        {
+            for(int j=0; j<run; j++)
+            {
+                bcache_insert(disk,lba+i+j,out + ((i+j) * CHUCHUOS_SECTOR_SIZE),false);
+            }
+        }
+
+        i += run;
+    }
+
+out:
+    return res;
+}
+
+//--------------------------------------------------------------------------------
+bool bcache_contains(struct disk* disk, unsigned int lba, int total)
+{
+    // true when any of the sectors is cached
+    if(!bcache_buffer_cache)
+    {
+        return false;
+    }
+
+    for(int i=0; i<total; i++)
+    {
+        if(bcache_lookup(disk,lba+i))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//--------------------------------------------------------------------------------
+int bcache_prefetch(struct disk* disk, unsigned int lba, int total)
+{
+    // brings sectors into the cache without anybody waiting for them yet
+    int res = 0;
+    int i = 0;
+
+    if(!bcache_buffer_cache)
+    {
+        return -EUNIMP;
+    }
+
+    if(!bcache_prefetch_buffer)
+    {
+        bcache_prefetch_buffer = kmalloc(CHUCHUOS_READAHEAD_MAX_SECTORS * CHUCHUOS_SECTOR_SIZE);
+        if(!bcache_prefetch_buffer)
+        {
+            return -ENOMEM;
+        }
+    }
+
+    if(total > CHUCHUOS_READAHEAD_MAX_SECTORS)
+    {
+        total = CHUCHUOS_READAHEAD_MAX_SECTORS;
+    }
+
+    // read-ahead stops at the end of the disk
+    if(lba >= disk->sectors)
+    {
+        return 0;
+    }
+
+    if(total > disk->sectors - lba)
+    {
+        total = disk->sectors - lba;
+    }
+
+    while(i < total)
+    {
+        if(bcache_lookup(disk,lba+i))
+        {
+            i++;
+            continue;
+        }
+
+        int run = 1;
+        while(i + run < total && !bcache_lookup(disk,lba+i+run))
+        {
+            run++;
+        }
+
+        res = disk_device_read(disk,lba+i,run,bcache_prefetch_buffer);
+        if(res < 0)
+        {
+            goto out;
+        }
+
+        bcache_stats.prefetched += run;
+        bcache_stats.device_reads++;
+
+        for(int j=0; j<run; j++)
+        {
+            bcache_insert(disk,lba+i+j,bcache_prefetch_buffer + (j * CHUCHUOS_SECTOR_SIZE),true);
+        }
+
+        i += run;
+    }
+
+out:
+    return res;
+}
+
+//--------------------------------------------------------------------------------
+void bcache_get_stats(struct bcache_stats* stats)
+{
+    *stats = bcache_stats;
+}
+
+//--------------------------------------------------------------------------------
+int bcache_write(struct disk* disk, unsigned int lba, int total, const void* buf)
+{
+    // returns as soon as the sectors are in the cache, they are only marked dirty
+    int res = 0;
+    const char* in = buf;
+
+    if(!bcache_buffer_cache)
+    {
+        return disk_device_write(disk,lba,total,buf);
+    }
+
+    for(int i=0; i<total; i++)
+    {
+        const char* data = in + (i * CHUCHUOS_SECTOR_SIZE);
+        struct bcache_buffer* buffer = bcache_lookup(disk,lba+i);
+
+        if(buffer)
+        {
+            memcpy(buffer->data,(void*)data,CHUCHUOS_SECTOR_SIZE);
+            buffer->prefetched = false;
+            bcache_lru_remove(buffer);
+            bcache_lru_push(buffer);
+        }
+        else
+        {
+            buffer = bcache_insert(disk,lba+i,data,false);
+        }
+
+        if(!buffer)
+        {
+            // no buffer to hold it, this sector is written through
+            res = disk_device_write(disk,lba+i,1,data);
+            if(res < 0)
+            {
+                goto out;
+            }
+            continue;
+        }
+
+        if(!buffer->dirty)
+        {
+            if(bcache_stats.dirty == 0)
+            {
+                bcache_dirty_since = timer_ticks();
+            }
+
+            buffer->dirty = true;
+            bcache_stats.dirty++;
+        }
+    }
+
+    bcache_stats.writes += total;
+
+    // a writer which keeps going must not fill the whole cache with sectors it cannot evict cheaply
+    if(bcache_stats.dirty > CHUCHUOS_BCACHE_DIRTY_MAX_SECTORS)
+    {
+        res = bcache_flush(disk);
+    }
+
+out:
+    return res;
+}
+
+//--------------------------------------------------------------------------------
+int bcache_flush(struct disk* disk)
+{
+    // writes back every dirty sector of disk, or of all disks when it is 0
+    struct bcache_buffer* buffer = bcache_lru_tail;
+
+    while(buffer && bcache_stats.dirty > 0)
+    {
+        if(buffer->dirty && (!disk || buffer->disk == disk))
+        {
+            int res = bcache_writeback(buffer);
+            if(res < 0)
+            {
+                return res;
+            }
+        }
+
+        buffer = buffer->lru_prev;
+    }
+
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+void bcache_writeback_expired()
+{
+    // called on the way into the disk layer, there is no thread to do it in the background.
+    // The drive's own write cache is left alone, only disk_flush is a barrier
+    if(bcache_stats.dirty == 0 || timer_ticks() - bcache_dirty_since < TIMER_MS_TO_TICKS(CHUCHUOS_BCACHE_WRITEBACK_MS))
+    {
+        return;
+    }
+
+    if(bcache_flush(0) < 0)
+    {
+        // a failing disk is tried again at the next deadline, not on every request
+        bcache_dirty_since = timer_ticks();
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include "config.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+struct disk;
+
+// One cached sector, found through its hash bucket and aged on the lru list
+struct bcache_buffer
+{
+    struct disk* disk;
+    unsigned int lba;
+    bool prefetched;    // read ahead of time and not asked for yet
+    bool dirty;         // written, but not on the disk yet
+
+    struct bcache_buffer* hash_next;
+    struct bcache_buffer* lru_next;     // towards the least recently used end
+    struct bcache_buffer* lru_prev;     // towards the most recently used end
+
+    char data[CHUCHUOS_SECTOR_SIZE];
+};
+
+struct bcache_stats
+{
+    uint32_t hits;          // sectors copied out of the cache
+    uint32_t misses;        // sectors which had to come from the disk
+    uint32_t device_reads;  // read requests passed down to the driver
+    uint32_t prefetched;    // sectors read ahead of time by bcache_prefetch
+    uint32_t prefetch_hits; // prefetched sectors which were asked for before being evicted
+    uint32_t evictions;
+    uint32_t writes;        // sectors written into the cache
+    uint32_t dirty;         // sectors the disk does not have yet
+    uint32_t writebacks;    // write requests passed down to the driver
+    uint32_t written_back;  // sectors those carried
+    uint32_t total_buffers;
+    uint32_t max_buffers;
+};
+
+void bcache_init();
+int bcache_read(struct disk* disk, unsigned int lba, int total, void* buf);
+bool bcache_contains(struct disk* disk, unsigned int lba, int total);
+int bcache_prefetch(struct disk* disk, unsigned int lba, int total);
+int bcache_write(struct disk* disk, unsigned int lba, int total, const void* buf);
+int bcache_flush(struct disk* disk);
+void bcache_writeback_expired();
+void bcache_get_stats(struct bcache_stats* stats);
+
+#endif
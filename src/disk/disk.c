@@ -1,64 +1,249 @@
 #include "disk.h"
-#include "io/io.h"
+#include "ata.h"
+#include "ahci.h"
+#include "virtio_blk.h"
+#include "ramdisk.h"
+#include "bcache.h"
 #include "config.h"
 #include "status.h"
 #include "memory/memory.h"
+#include "time/tsc.h"
 
-struct disk disk;
+// disks are numbered in the order they are found, the boot disk comes first
+static struct disk disks[CHUCHUOS_MAX_DISKS];
+static int total_disks = 0;
 
-int disk_read_sector(int lba, int total, void* buf)
+static void disk_register(struct disk* disk, CHUCHUOS_DISK_TYPE type)
 {
-    outb(0x1F6, (lba >> 24) | 0xE0);
-    outb(0x1F2, total);
-    outb(0x1F3, (unsigned char)(lba & 0xff));
-    outb(0x1F4, (unsigned char)(lba >> 8));
-    outb(0x1F5, (unsigned char)(lba >> 16));
-    outb(0x1F7, 0x20);
-
-    unsigned short* ptr = (unsigned short*) buf;
-    for (int b = 0; b < total; b++)
-    {
-        // Wait for the buffer to be ready
-        char c = insb(0x1F7);
-        while(!(c & 0x08))
+    disk->type = type;
+    disk->sector_size = CHUCHUOS_SECTOR_SIZE;
+    disk->id = total_disks;
+    if (!disk->max_sectors)
+    {
+        disk->max_sectors = CHUCHUOS_DISK_MAX_SECTORS_PER_READ;
+    }
+    disk_queue_init(&disk->queue);
+    total_disks++;
+
+    disk->filesystem = fs_resolve(disk);
+}
+
+void disk_search_and_init()
+{
+    // every disk read goes through the sector cache
+    bcache_init();
+
+    memset(disks, 0, sizeof(disks));
+    total_disks = 0;
+
+    // the legacy ata devices come first, the bios boots from those when there are any
+    for (int i = 0; i < ATA_TOTAL_DEVICES && total_disks < CHUCHUOS_MAX_DISKS; i++)
+    {
+        if (ata_probe(&disks[total_disks], i) == 0)
         {
-            c = insb(0x1F7);
+            disk_register(&disks[total_disks], CHUCHUOS_DISK_TYPE_REAL);
         }
+    }
 
-        // Copy from hard disk to memory
-        for (int i = 0; i < 256; i++)
+    for (int i = 0; i < AHCI_MAX_PORTS && total_disks < CHUCHUOS_MAX_DISKS; i++)
+    {
+        if (ahci_probe(&disks[total_disks], i) == 0)
         {
-            *ptr = insw(0x1F0);
-            ptr++;
+            disk_register(&disks[total_disks], CHUCHUOS_DISK_TYPE_AHCI);
         }
-
     }
-    return 0;
-}
 
-void disk_search_and_init()
-{
-    memset(&disk, 0, sizeof(disk));
-    disk.type = CHUCHUOS_DISK_TYPE_REAL;
-    disk.sector_size = CHUCHUOS_SECTOR_SIZE;
-    disk.id = 0;
-    disk.filesystem = fs_resolve(&disk);
+    for (int i = 0; i < VIRTIO_BLK_MAX_DEVICES && total_disks < CHUCHUOS_MAX_DISKS; i++)
+    {
+        if (virtio_blk_probe(&disks[total_disks], i) < 0)
+        {
+            break;
+        }
+
+        disk_register(&disks[total_disks], CHUCHUOS_DISK_TYPE_VIRTIO);
+    }
 }
 
 struct disk* disk_get(int index)
 {
-    if (index != 0)
+    if (index < 0 || index >= total_disks)
         return 0;
     
-    return &disk;
+    return &disks[index];
 }
 
 int disk_read_block(struct disk* idisk, unsigned int lba, int total, void* buf)
 {
-    if (idisk != &disk)
+    int res = 0;
+    uint64_t start = tsc_read();
+
+    if (idisk != disk_get(idisk->id))
+    {
+        return -EIO;
+    }
+
+    if (lba >= idisk->sectors || total > idisk->sectors - lba)
+    {
+        return -EIO;
+    }
+
+    // caching sectors which are in memory anyway would only add a copy
+    if (idisk->map)
+    {
+        res = disk_device_read(idisk, lba, total, buf);
+    }
+    else
+    {
+        bcache_writeback_expired();
+        res = bcache_read(idisk, lba, total, buf);
+    }
+
+    disk_iostat_account(idisk, &idisk->iostat.reads[idisk->io_class], idisk->iostat.read_latency, total, tsc_read() - start);
+    return res;
+}
+
+int disk_device_read(struct disk* idisk, unsigned int lba, int total, void* buf)
+{
+    // every read command the driver gets comes through here, the sector cache's too
+    uint64_t start = tsc_read();
+    int res = idisk->read(idisk, lba, total, buf);
+
+    disk_iostat_account(idisk, &idisk->iostat.device_reads, idisk->iostat.device_latency, total, tsc_read() - start);
+    return res;
+}
+
+int disk_device_write(struct disk* idisk, unsigned int lba, int total, const void* buf)
+{
+    uint64_t start = tsc_read();
+    int res = idisk->write(idisk, lba, total, buf);
+
+    disk_iostat_account(idisk, &idisk->iostat.device_writes, idisk->iostat.device_latency, total, tsc_read() - start);
+    return res;
+}
+
+int disk_write_block(struct disk* idisk, unsigned int lba, int total, const void* buf)
+{
+    // whole sectors, they land in the sector cache and reach the disk later, see disk_flush
+    int res = 0;
+    uint64_t start = tsc_read();
+
+    if (idisk != disk_get(idisk->id))
+    {
+        return -EIO;
+    }
+
+    if (!idisk->write)
+    {
+        return -ERDONLY;
+    }
+
+    if (lba >= idisk->sectors || total > idisk->sectors - lba)
+    {
+        return -EIO;
+    }
+
+    if (idisk->map)
+    {
+        res = disk_device_write(idisk, lba, total, buf);
+    }
+    else
+    {
+        bcache_writeback_expired();
+        res = bcache_write(idisk, lba, total, buf);
+    }
+
+    disk_iostat_account(idisk, &idisk->iostat.writes[idisk->io_class], idisk->iostat.write_latency, total, tsc_read() - start);
+    return res;
+}
+
+int disk_flush(struct disk* idisk)
+{
+    // a barrier, every write before it is on the medium once it returns
+    int res = bcache_flush(idisk);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    if (!idisk->flush)
+    {
+        return 0;
+    }
+
+    uint64_t start = tsc_read();
+    res = idisk->flush(idisk);
+
+    disk_iostat_account(idisk, &idisk->iostat.device_flushes, 0, 0, tsc_read() - start);
+    return res;
+}
+
+int disk_submit_block(struct disk* idisk, unsigned int lba, int total, void* buf)
+{
+    // bulk reads the sector cache would not keep anyway go to the device without waiting,
+    // unless some of their sectors are cached already
+    if (!idisk->submit || total < CHUCHUOS_BCACHE_BYPASS_SECTORS || bcache_contains(idisk, lba, total))
+    {
+        return disk_read_block(idisk, lba, total, buf);
+    }
+
+    if (idisk != disk_get(idisk->id))
     {
         return -EIO;
     }
 
-    return disk_read_sector(lba, total, buf);
+    if (lba >= idisk->sectors || total > idisk->sectors - lba)
+    {
+        return -EIO;
+    }
+
+    // nobody waits for it here, the time goes to disk_complete
+    disk_iostat_account(idisk, &idisk->iostat.reads[idisk->io_class], 0, total, 0);
+    disk_iostat_account(idisk, &idisk->iostat.device_reads, 0, total, 0);
+    return idisk->submit(idisk, lba, total, buf);
+}
+
+int disk_complete(struct disk* idisk)
+{
+    if (!idisk->complete)
+    {
+        return 0;
+    }
+
+    uint64_t start = tsc_read();
+    int res = idisk->complete(idisk);
+
+    idisk->iostat.device_reads.busy_cycles += tsc_read() - start;
+    return res;
+}
+
+void* disk_map_block(struct disk* idisk, unsigned int lba, int total)
+{
+    // 0 unless all of the sectors can be used in place
+    if (!idisk->map || lba >= idisk->sectors || total > idisk->sectors - lba)
+    {
+        return 0;
+    }
+
+    // the caller copies the sectors itself, there is no time to measure
+    disk_iostat_account(idisk, &idisk->iostat.reads[idisk->io_class], 0, total, 0);
+    return idisk->map(idisk, lba);
+}
+
+struct disk* disk_register_ramdisk(void* data, unsigned int sectors)
+{
+    // gets the next free drive number
+    if (total_disks == CHUCHUOS_MAX_DISKS)
+    {
+        return 0;
+    }
+
+    struct disk* disk = &disks[total_disks];
+    memset(disk, 0, sizeof(struct disk));
+    if (ramdisk_init(disk, data, sectors) < 0)
+    {
+        return 0;
+    }
+
+    disk_register(disk, CHUCHUOS_DISK_TYPE_RAM);
+    return disk;
 }
\ No newline at end of file
@@ -2,21 +2,66 @@
 #define DISK_H
 
 #include "fs/file.h"
+#include "disk/queue.h"
+#include "disk/iostat.h"
 
 typedef unsigned int CHUCHUOS_DISK_TYPE;
 
 
 // Represents a real physical hard disk
 #define CHUCHUOS_DISK_TYPE_REAL 0
+// A serial ata disk behind an ahci controller
+#define CHUCHUOS_DISK_TYPE_AHCI 1
+// A virtio block device of a virtual machine
+#define CHUCHUOS_DISK_TYPE_VIRTIO 2
+// A disk image in memory, e.g. the initrd
+#define CHUCHUOS_DISK_TYPE_RAM 3
+
+struct disk;
+
+// reads total sectors straight from the device, without the sector cache
+typedef int (*DISK_READ_FUNCTION)(struct disk* disk, unsigned int lba, int total, void* buf);
+// starts such a read and returns before it is done, the device may have several in flight
+typedef int (*DISK_SUBMIT_FUNCTION)(struct disk* disk, unsigned int lba, int total, void* buf);
+// waits for every submitted read, fails if any of them did
+typedef int (*DISK_COMPLETE_FUNCTION)(struct disk* disk);
+// where the sector lba already sits in memory, for disks which have all of them there
+typedef void* (*DISK_MAP_FUNCTION)(struct disk* disk, unsigned int lba);
+// writes total sectors straight to the device, they may still sit in its write cache
+typedef int (*DISK_WRITE_FUNCTION)(struct disk* disk, unsigned int lba, int total, const void* buf);
+// returns once everything written so far is on the medium
+typedef int (*DISK_FLUSH_FUNCTION)(struct disk* disk);
 
 struct disk
 {
     CHUCHUOS_DISK_TYPE type;
     int sector_size;
 
-    // The id of the disk
+    // The id of the disk, also its drive number in paths
     int id;
 
+    // addressable sectors, reads past them fail
+    unsigned int sectors;
+    // the most one read may transfer, set by the driver
+    unsigned int max_sectors;
+
+    DISK_READ_FUNCTION read;
+    DISK_SUBMIT_FUNCTION submit;        // optional, together with complete
+    DISK_COMPLETE_FUNCTION complete;
+    DISK_MAP_FUNCTION map;              // optional, such a disk is read without the sector cache
+    DISK_WRITE_FUNCTION write;          // optional, the disk is read-only without it
+    DISK_FLUSH_FUNCTION flush;          // optional, for devices with a write cache of their own
+
+    // The private data of the driver behind read
+    void* driver_private;
+
+    // reads waiting to be sorted and merged
+    struct disk_queue queue;
+
+    // what the requests going on right now are for, set by the disk stream issuing them
+    DISK_IO_CLASS io_class;
+    struct disk_iostat iostat;
+
     struct filesystem* filesystem;
 
     // The private data of our filesystem
@@ -26,5 +71,13 @@ struct disk
 void disk_search_and_init();
 struct disk* disk_get(int index);
 int disk_read_block(struct disk* idisk, unsigned int lba, int total, void* buf);
+int disk_submit_block(struct disk* idisk, unsigned int lba, int total, void* buf);
+int disk_complete(struct disk* idisk);
+int disk_write_block(struct disk* idisk, unsigned int lba, int total, const void* buf);
+int disk_device_read(struct disk* idisk, unsigned int lba, int total, void* buf);
+int disk_device_write(struct disk* idisk, unsigned int lba, int total, const void* buf);
+int disk_flush(struct disk* idisk);
+void* disk_map_block(struct disk* idisk, unsigned int lba, int total);
+struct disk* disk_register_ramdisk(void* data, unsigned int sectors);
 
 #endif
\ No newline at end of file
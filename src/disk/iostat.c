@@ -0,0 +1,154 @@
+#include "iostat.h"
+#include "disk.h"
+#include "kernel.h"
+#include "memory/memory.h"
+#include "string/string.h"
+#include <stdbool.h>
+
+static const char* disk_io_class_names[DISK_IO_TOTAL_CLASSES] =
+{
+    "other", "data", "fat", "directory"
+};
+
+//--------------------------------------------------------------------------------
+static int disk_iostat_bucket(uint64_t cycles)
+{
+    // log2 of the cycles, without a 64 bit helper from libgcc
+    uint32_t high = cycles >> 32;
+    uint32_t low = (uint32_t)cycles;
+    int bucket = 0;
+
+    if(high)
+    {
+        bucket = 32 + (31 - __builtin_clz(high));
+    }
+    else if(low)
+    {
+        bucket = 31 - __builtin_clz(low);
+    }
+
+    if(bucket >= DISK_IOSTAT_LATENCY_BUCKETS)
+    {
+        bucket = DISK_IOSTAT_LATENCY_BUCKETS - 1;
+    }
+
+    return bucket;
+}
+
+//--------------------------------------------------------------------------------
+void disk_iostat_account(struct disk* disk, struct disk_io_counters* counters, uint32_t* latency, unsigned int sectors, uint64_t cycles)
+{
+    // latency is 0 for requests whose time is not worth a histogram entry
+    counters->commands++;
+    counters->sectors += sectors;
+    counters->bytes += (uint64_t)sectors * disk->sector_size;
+    counters->busy_cycles += cycles;
+
+    if(latency)
+    {
+        latency[disk_iostat_bucket(cycles)]++;
+    }
+}
+
+//--------------------------------------------------------------------------------
+void disk_iostat_get(struct disk* disk, struct disk_iostat* stats)
+{
+    *stats = disk->iostat;
+}
+
+//--------------------------------------------------------------------------------
+void disk_iostat_reset(struct disk* disk)
+{
+    memset(&disk->iostat, 0, sizeof(struct disk_iostat));
+}
+
+//--------------------------------------------------------------------------------
+static void disk_iostat_print_value(const char* label, uint32_t value)
+{
+    char buf[33];
+
+    print(label);
+    print(itoa(value, buf, 10));
+}
+
+//--------------------------------------------------------------------------------
+static void disk_iostat_print_counters(const char* name, const char* kind, struct disk_io_counters* counters)
+{
+    // bytes in kb and busy time in units of 2^20 cycles, print only takes 32 bit numbers
+    if(!counters->commands)
+    {
+        return;
+    }
+
+    print("  ");
+    print(name);
+    print(" ");
+    print(kind);
+    disk_iostat_print_value(": ", counters->commands);
+    disk_iostat_print_value(" sectors: ", counters->sectors);
+    disk_iostat_print_value(" kb: ", (uint32_t)(counters->bytes >> 10));
+    disk_iostat_print_value(" busy mcycles: ", (uint32_t)(counters->busy_cycles >> 20));
+    print("\n");
+}
+
+//--------------------------------------------------------------------------------
+static void disk_iostat_print_latency(const char* name, uint32_t* latency)
+{
+    bool any = false;
+
+    for(int i = 0; i < DISK_IOSTAT_LATENCY_BUCKETS; i++)
+    {
+        if(!latency[i])
+        {
+            continue;
+        }
+
+        if(!any)
+        {
+            print("  ");
+            print(name);
+            print(" latency, log2 cycles:");
+            any = true;
+        }
+
+        disk_iostat_print_value(" ", i);
+        disk_iostat_print_value("=", latency[i]);
+    }
+
+    if(any)
+    {
+        print("\n");
+    }
+}
+
+//--------------------------------------------------------------------------------
+void disk_iostat_print(struct disk* disk)
+{
+    struct disk_iostat* stats = &disk->iostat;
+
+    disk_iostat_print_value("disk ", disk->id);
+    print(":\n");
+
+    for(int i = 0; i < DISK_IO_TOTAL_CLASSES; i++)
+    {
+        disk_iostat_print_counters(disk_io_class_names[i], "reads", &stats->reads[i]);
+        disk_iostat_print_counters(disk_io_class_names[i], "writes", &stats->writes[i]);
+    }
+
+    disk_iostat_print_counters("device", "reads", &stats->device_reads);
+    disk_iostat_print_counters("device", "writes", &stats->device_writes);
+    disk_iostat_print_counters("device", "flushes", &stats->device_flushes);
+
+    disk_iostat_print_latency("read", stats->read_latency);
+    disk_iostat_print_latency("write", stats->write_latency);
+    disk_iostat_print_latency("device", stats->device_latency);
+}
+
+//--------------------------------------------------------------------------------
+void disk_iostat_print_all()
+{
+    for(int i = 0; disk_get(i); i++)
+    {
+        disk_iostat_print(disk_get(i));
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef DISK_IOSTAT_H
+#define DISK_IOSTAT_H
+
+#include <stdint.h>
+
+struct disk;
+
+// What a request into the disk layer was for, filesystems tag their disk streams with it
+typedef unsigned int DISK_IO_CLASS;
+
+#define DISK_IO_OTHER       0
+#define DISK_IO_DATA        1
+#define DISK_IO_FAT         2
+#define DISK_IO_DIRECTORY   3
+#define DISK_IO_TOTAL_CLASSES   4
+
+// bucket n counts requests which took 2^n to 2^(n+1)-1 tsc cycles, the last one everything longer
+#define DISK_IOSTAT_LATENCY_BUCKETS 40
+
+struct disk_io_counters
+{
+    uint32_t commands;
+    uint32_t sectors;
+    uint64_t bytes;
+    uint64_t busy_cycles;   // tsc cycles from the call until it returned
+};
+
+struct disk_iostat
+{
+    // disk_read_block and disk_write_block, sector cache hits included, by what they were for
+    struct disk_io_counters reads[DISK_IO_TOTAL_CLASSES];
+    struct disk_io_counters writes[DISK_IO_TOTAL_CLASSES];
+    uint32_t read_latency[DISK_IOSTAT_LATENCY_BUCKETS];
+    uint32_t write_latency[DISK_IOSTAT_LATENCY_BUCKETS];
+
+    // what the driver got to do
+    struct disk_io_counters device_reads;
+    struct disk_io_counters device_writes;
+    struct disk_io_counters device_flushes;
+    uint32_t device_latency[DISK_IOSTAT_LATENCY_BUCKETS];
+};
+
+void disk_iostat_account(struct disk* disk, struct disk_io_counters* counters, uint32_t* latency, unsigned int sectors, uint64_t cycles);
+void disk_iostat_get(struct disk* disk, struct disk_iostat* stats);
+void disk_iostat_reset(struct disk* disk);
+void disk_iostat_print(struct disk* disk);
+void disk_iostat_print_all();
+
+#endif
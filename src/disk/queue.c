@@ -0,0 +1,203 @@
+#include "queue.h"
+#include "disk.h"
+#include "config.h"
+#include "status.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+#include <stdbool.h>
+
+static struct slab_cache* disk_request_cache = 0;
+
+//--------------------------------------------------------------------------------
+void disk_queue_init(struct disk_queue* queue)
+{
+    if(!disk_request_cache)
+    {
+        disk_request_cache = kcache_create("disk_request",sizeof(struct disk_request));
+    }
+
+    memset(queue,0,sizeof(struct disk_queue));
+}
+
+//--------------------------------------------------------------------------------
+int disk_queue_submit(struct disk* disk, unsigned int lba, int total, void* buf)
+{
+    struct disk_queue* queue = &disk->queue;
+
+    // no single read may be longer than the driver can transfer at once
+    while(total > disk->max_sectors)
+    {
+        int res = disk_queue_submit(disk,lba,disk->max_sectors,buf);
+        if(res < 0)
+        {
+            return res;
+        }
+
+        lba += disk->max_sectors;
+        total -= disk->max_sectors;
+        buf += disk->max_sectors * CHUCHUOS_SECTOR_SIZE;
+    }
+
+    if(total <= 0)
+    {
+        return 0;
+    }
+
+    struct disk_request* request = disk_request_cache ? kcache_zalloc(disk_request_cache) : 0;
+    if(!request)
+    {
+        // nothing to queue it in, read it right away
+        return disk_read_block(disk,lba,total,buf);
+    }
+
+    request->lba = lba;
+    request->total = total;
+    request->buf = buf;
+
+    // keep the queue sorted, equal lbas stay in submission order
+    struct disk_request** link = &queue->head;
+    while(*link && (*link)->lba <= lba)
+    {
+        link = &(*link)->next;
+    }
+
+    request->next = *link;
+    *link = request;
+
+    queue->stats.submitted++;
+    queue->stats.depth++;
+    if(queue->stats.depth > queue->stats.max_depth)
+    {
+        queue->stats.max_depth = queue->stats.depth;
+    }
+
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+static int disk_queue_dispatch(struct disk* disk, struct disk_request* first, struct disk_request* last, unsigned int end)
+{
+    // one read covers first..last, they either share one contiguous buffer or go through the bounce buffer
+    struct disk_queue* queue = &disk->queue;
+    int total = end - first->lba;
+    bool contiguous = true;
+    int res = 0;
+
+    for(struct disk_request* request = first->next; request != last->next; request = request->next)
+    {
+        if(request->buf != first->buf + ((request->lba - first->lba) * CHUCHUOS_SECTOR_SIZE))
+        {
+            contiguous = false;
+        }
+    }
+
+    if(contiguous)
+    {
+        // the disk may start it and take the next one before it is done, see disk_queue_run
+        queue->stats.dispatched++;
+        return disk_submit_block(disk,first->lba,total,first->buf);
+    }
+
+    if(!queue->bounce && total <= CHUCHUOS_DISK_MAX_SECTORS_PER_READ)
+    {
+        queue->bounce = kmalloc(CHUCHUOS_DISK_MAX_SECTORS_PER_READ * CHUCHUOS_SECTOR_SIZE);
+    }
+
+    if(!queue->bounce || total > CHUCHUOS_DISK_MAX_SECTORS_PER_READ)
+    {
+        // no memory for the bounce buffer or too much for it, every request gets a read of its own
+        for(struct disk_request* request = first; request != last->next; request = request->next)
+        {
+            res = disk_read_block(disk,request->lba,request->total,request->buf);
+            queue->stats.dispatched++;
+            if(res < 0)
+            {
+                return res;
+            }
+        }
+
+        return 0;
+    }
+
+    res = disk_read_block(disk,first->lba,total,queue->bounce);
+    queue->stats.dispatched++;
+    queue->stats.bounced++;
+    if(res < 0)
+    {
+        return res;
+    }
+
+    for(struct disk_request* request = first; request != last->next; request = request->next)
+    {
+        memcpy(request->buf,queue->bounce + ((request->lba - first->lba) * CHUCHUOS_SECTOR_SIZE),request->total * CHUCHUOS_SECTOR_SIZE);
+    }
+
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+int disk_queue_run(struct disk* disk)
+{
+    // one sweep in ascending lba order, requests which overlap or touch are merged into one read
+    struct disk_queue* queue = &disk->queue;
+    int res = 0;
+
+    while(queue->head)
+    {
+        struct disk_request* first = queue->head;
+        struct disk_request* last = first;
+        unsigned int end = first->lba + first->total;
+        uint32_t count = 1;
+
+        while(last->next && last->next->lba <= end)
+        {
+            unsigned int next_end = last->next->lba + last->next->total;
+            if(next_end < end)
+            {
+                next_end = end;
+            }
+
+            if(next_end - first->lba > disk->max_sectors)
+            {
+                break;
+            }
+
+            end = next_end;
+            last = last->next;
+            count++;
+        }
+
+        int dispatch_res = disk_queue_dispatch(disk,first,last,end);
+        if(dispatch_res < 0 && res == 0)
+        {
+            // keep going, the other requests may still succeed
+            res = dispatch_res;
+        }
+
+        queue->head = last->next;
+        queue->stats.merged += count - 1;
+        queue->stats.depth -= count;
+
+        while(first != queue->head)
+        {
+            struct disk_request* next = first->next;
+            kcache_free(disk_request_cache,first);
+            first = next;
+        }
+    }
+
+    // the reads the disk was still working on
+    int complete_res = disk_complete(disk);
+    if(complete_res < 0 && res == 0)
+    {
+        res = complete_res;
+    }
+
+    return res;
+}
+
+//--------------------------------------------------------------------------------
+void disk_queue_get_stats(struct disk* disk, struct disk_queue_stats* stats)
+{
+    *stats = disk->queue.stats;
+}
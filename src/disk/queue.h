@@ -0,0 +1,40 @@
+#ifndef DISK_QUEUE_H
+#define DISK_QUEUE_H
+
+#include <stdint.h>
+
+struct disk;
+
+// A read waiting in the queue of its disk until disk_queue_run
+struct disk_request
+{
+    unsigned int lba;
+    int total;
+    char* buf;
+
+    struct disk_request* next;
+};
+
+struct disk_queue_stats
+{
+    uint32_t submitted;     // requests queued
+    uint32_t dispatched;    // reads sent down after merging
+    uint32_t merged;        // requests folded into the read of a neighbour
+    uint32_t bounced;       // merged reads whose buffers were not contiguous
+    uint32_t depth;         // requests waiting right now
+    uint32_t max_depth;
+};
+
+struct disk_queue
+{
+    struct disk_request* head;  // sorted by lba, the order of one elevator sweep
+    char* bounce;               // CHUCHUOS_DISK_MAX_SECTORS_PER_READ sectors, allocated on first use
+    struct disk_queue_stats stats;
+};
+
+void disk_queue_init(struct disk_queue* queue);
+int disk_queue_submit(struct disk* disk, unsigned int lba, int total, void* buf);
+int disk_queue_run(struct disk* disk);
+void disk_queue_get_stats(struct disk* disk, struct disk_queue_stats* stats);
+
+#endif
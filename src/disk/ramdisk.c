@@ -0,0 +1,105 @@
+#include "ramdisk.h"
+#include "disk.h"
+#include "config.h"
+#include "status.h"
+#include "fs/file.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+
+// A disk image kept in memory, its sectors are handed out in place
+
+//--------------------------------------------------------------------------------
+static int ramdisk_read_sectors(struct disk* disk, unsigned int lba, int total, void* buf)
+{
+    memcpy(buf, (char*)disk->driver_private + (lba * CHUCHUOS_SECTOR_SIZE), total * CHUCHUOS_SECTOR_SIZE);
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+static int ramdisk_write_sectors(struct disk* disk, unsigned int lba, int total, const void* buf)
+{
+    // there is nothing behind the memory, writes are durable as far as they can be at once
+    memcpy((char*)disk->driver_private + (lba * CHUCHUOS_SECTOR_SIZE), (void*)buf, total * CHUCHUOS_SECTOR_SIZE);
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+static void* ramdisk_map(struct disk* disk, unsigned int lba)
+{
+    return (char*)disk->driver_private + (lba * CHUCHUOS_SECTOR_SIZE);
+}
+
+//--------------------------------------------------------------------------------
+int ramdisk_init(struct disk* disk, void* data, unsigned int sectors)
+{
+    if(!data || sectors == 0)
+    {
+        return -EINVARG;
+    }
+
+    disk->read = ramdisk_read_sectors;
+    disk->write = ramdisk_write_sectors;
+    disk->map = ramdisk_map;
+    disk->sectors = sectors;
+    disk->driver_private = data;
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+int ramdisk_load(const char* path)
+{
+    // reads a whole image file into memory and registers it as a disk, returns its id
+    int res = 0;
+    char* data = 0;
+    struct file_stat stat;
+
+    int fd = fopen(path, "r");
+    if(fd <= 0)
+    {
+        return -EIO;
+    }
+
+    res = fstat(fd, &stat);
+    if(res < 0)
+    {
+        goto out;
+    }
+
+    unsigned int sectors = (stat.filesize + CHUCHUOS_SECTOR_SIZE - 1) / CHUCHUOS_SECTOR_SIZE;
+    if(sectors == 0)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    // the tail of a partial last sector reads as zeros
+    data = kzalloc(sectors * CHUCHUOS_SECTOR_SIZE);
+    if(!data)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    if(fread(data, stat.filesize, 1, fd) != 1)
+    {
+        res = -EIO;
+        goto out;
+    }
+
+    struct disk* disk = disk_register_ramdisk(data, sectors);
+    if(!disk)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    res = disk->id;
+
+out:
+    if(res < 0 && data)
+    {
+        kfree(data);
+    }
+    fclose(fd);
+    return res;
+}
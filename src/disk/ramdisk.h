@@ -0,0 +1,9 @@
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+struct disk;
+
+int ramdisk_init(struct disk* disk, void* data, unsigned int sectors);
+int ramdisk_load(const char* path);
+
+#endif
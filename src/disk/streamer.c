@@ -1,6 +1,12 @@
 #include "streamer.h"
+#include "bcache.h"
 #include "memory/heap/kheap.h"
 #include "config.h"
+#include "memory/memory.h"
+#include <stdbool.h>
+
+static struct diskstreamer_stats diskstreamer_stats;
+
 struct disk_stream* diskstreamer_new(int disk_id)
 {
     struct disk* disk = disk_get(disk_id);
@@ -10,46 +16,290 @@ struct disk_stream* diskstreamer_new(int disk_id)
     }
 
     struct disk_stream* streamer = kzalloc(sizeof(struct disk_stream));
+    if (!streamer)
+    {
+        return 0;
+    }
+
     streamer->pos = 0;
+    streamer->last_end = (uint64_t)-1;
     streamer->disk = disk;
     return streamer;
 }
 
-int diskstreamer_seek(struct disk_stream* stream, int pos)
+int diskstreamer_seek(struct disk_stream* stream, uint64_t pos)
 {
     stream->pos = pos;
     return 0;
 }
 
+void diskstreamer_set_io_class(struct disk_stream* stream, DISK_IO_CLASS io_class)
+{
+    stream->io_class = io_class;
+}
+
+static int diskstreamer_read_partial(struct disk_stream* stream, char* out, int total)
+{
+    // a piece of a single sector, read through a bounce buffer
+    unsigned int sector = stream->pos / CHUCHUOS_SECTOR_SIZE;
+    int offset = stream->pos % CHUCHUOS_SECTOR_SIZE;
+    char buf[CHUCHUOS_SECTOR_SIZE];
+
+    int res = disk_read_block(stream->disk, sector, 1, buf);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    memcpy(out, buf + offset, total);
+    stream->pos += total;
+    return 0;
+}
+
+static void diskstreamer_readahead(struct disk_stream* stream, int total)
+{
+    // called before a read of total bytes at stream->pos
+    unsigned int first_sector = stream->pos / CHUCHUOS_SECTOR_SIZE;
+    unsigned int end_sector = (stream->pos + total + CHUCHUOS_SECTOR_SIZE - 1) / CHUCHUOS_SECTOR_SIZE;
+
+    bool sequential = stream->pos == stream->last_end;
+    stream->last_end = stream->pos + total;
+
+    if (!sequential)
+    {
+        if (stream->readahead_window)
+        {
+            stream->readahead_window /= 2;
+            diskstreamer_stats.window_shrinks++;
+        }
+
+        if (stream->readahead_window < CHUCHUOS_READAHEAD_MIN_SECTORS)
+        {
+            stream->readahead_window = 0;
+        }
+
+        return;
+    }
+
+    // bulk reads already get big commands of their own
+    if (end_sector - first_sector >= CHUCHUOS_BCACHE_BYPASS_SECTORS)
+    {
+        return;
+    }
+
+    if (stream->readahead_window < CHUCHUOS_READAHEAD_MAX_SECTORS)
+    {
+        stream->readahead_window = stream->readahead_window ? stream->readahead_window * 2 : CHUCHUOS_READAHEAD_MIN_SECTORS;
+        if (stream->readahead_window > CHUCHUOS_READAHEAD_MAX_SECTORS)
+        {
+            stream->readahead_window = CHUCHUOS_READAHEAD_MAX_SECTORS;
+        }
+
+        diskstreamer_stats.window_grows++;
+    }
+
+    // the window starts at this read, so the read itself and the sectors after it come in one
+    // request. Whatever the previous prefetch of this stream covered is skipped
+    unsigned int start = first_sector;
+    unsigned int end = first_sector + stream->readahead_window;
+
+    if (stream->readahead_end > start && stream->readahead_end <= end)
+    {
+        start = stream->readahead_end;
+    }
+
+    if (end <= end_sector || start >= end)
+    {
+        return;
+    }
+
+    if (bcache_prefetch(stream->disk, start, end - start) < 0)
+    {
+        return;
+    }
+
+    stream->readahead_end = end;
+}
+
+static int diskstreamer_read_sectors(struct disk_stream* stream, void* out, int total, bool deferred)
+{
+    int res = 0;
+    char* ptr = out;
+
+    // the requests below are accounted to this stream's class
+    stream->disk->io_class = stream->io_class;
+
+    // a disk in memory hands out its sectors in place, one copy and no bounce buffers
+    unsigned int first_sector = stream->pos / CHUCHUOS_SECTOR_SIZE;
+    unsigned int end_sector = (stream->pos + total + CHUCHUOS_SECTOR_SIZE - 1) / CHUCHUOS_SECTOR_SIZE;
+    char* data = disk_map_block(stream->disk, first_sector, end_sector - first_sector);
+    if (data)
+    {
+        memcpy(ptr, data + (stream->pos % CHUCHUOS_SECTOR_SIZE), total);
+        stream->pos += total;
+        return 0;
+    }
+
+    diskstreamer_readahead(stream, total);
+
+    // unaligned head, up to the next sector boundary
+    int offset = stream->pos % CHUCHUOS_SECTOR_SIZE;
+    if (offset && total > 0)
+    {
+        int total_to_read = CHUCHUOS_SECTOR_SIZE - offset;
+        if (total_to_read > total)
+        {
+            total_to_read = total;
+        }
+
+        res = diskstreamer_read_partial(stream, ptr, total_to_read);
+        if (res < 0)
+        {
+            goto out;
+        }
+
+        ptr += total_to_read;
+        total -= total_to_read;
+    }
+
+    // whole sectors go straight into the caller's buffer, as few disk requests as possible
+    while (total >= CHUCHUOS_SECTOR_SIZE)
+    {
+        int total_sectors = total / CHUCHUOS_SECTOR_SIZE;
+        if (total_sectors > stream->disk->max_sectors)
+        {
+            total_sectors = stream->disk->max_sectors;
+        }
+
+        if (deferred)
+        {
+            res = disk_queue_submit(stream->disk, stream->pos / CHUCHUOS_SECTOR_SIZE, total_sectors, ptr);
+        }
+        else
+        {
+            res = disk_read_block(stream->disk, stream->pos / CHUCHUOS_SECTOR_SIZE, total_sectors, ptr);
+        }
+
+        if (res < 0)
+        {
+            goto out;
+        }
+
+        ptr += total_sectors * CHUCHUOS_SECTOR_SIZE;
+        total -= total_sectors * CHUCHUOS_SECTOR_SIZE;
+        stream->pos += total_sectors * CHUCHUOS_SECTOR_SIZE;
+    }
+
+    // unaligned tail
+    if (total > 0)
+    {
+        res = diskstreamer_read_partial(stream, ptr, total);
+    }
+
+out:
+    return res;
+}
+
 int diskstreamer_read(struct disk_stream* stream, void* out, int total)
 {
-    int sector = stream->pos / CHUCHUOS_SECTOR_SIZE;
+    return diskstreamer_read_sectors(stream, out, total, false);
+}
+
+int diskstreamer_read_deferred(struct disk_stream* stream, void* out, int total)
+{
+    // the whole sectors are only queued, out is not complete before diskstreamer_flush
+    return diskstreamer_read_sectors(stream, out, total, true);
+}
+
+static int diskstreamer_write_partial(struct disk_stream* stream, const char* in, int total)
+{
+    // a piece of a single sector, the rest of it has to be read first
+    unsigned int sector = stream->pos / CHUCHUOS_SECTOR_SIZE;
     int offset = stream->pos % CHUCHUOS_SECTOR_SIZE;
     char buf[CHUCHUOS_SECTOR_SIZE];
 
     int res = disk_read_block(stream->disk, sector, 1, buf);
     if (res < 0)
     {
-        goto out;
+        return res;
+    }
+
+    memcpy(buf + offset, (void*)in, total);
+    res = disk_write_block(stream->disk, sector, 1, buf);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    stream->pos += total;
+    return 0;
+}
+
+int diskstreamer_write(struct disk_stream* stream, const void* in, int total)
+{
+    int res = 0;
+    const char* ptr = in;
+
+    stream->disk->io_class = stream->io_class;
+
+    // unaligned head, up to the next sector boundary
+    int offset = stream->pos % CHUCHUOS_SECTOR_SIZE;
+    if (offset && total > 0)
+    {
+        int total_to_write = CHUCHUOS_SECTOR_SIZE - offset;
+        if (total_to_write > total)
+        {
+            total_to_write = total;
+        }
+
+        res = diskstreamer_write_partial(stream, ptr, total_to_write);
+        if (res < 0)
+        {
+            goto out;
+        }
+
+        ptr += total_to_write;
+        total -= total_to_write;
     }
 
-    int total_to_read = total > CHUCHUOS_SECTOR_SIZE ? CHUCHUOS_SECTOR_SIZE : total;
-    for (int i = 0; i < total_to_read; i++)
+    // whole sectors need no read, the cache takes them all at once
+    if (total >= CHUCHUOS_SECTOR_SIZE)
     {
-        *(char*)out++ = buf[offset+i];
+        int total_sectors = total / CHUCHUOS_SECTOR_SIZE;
+
+        res = disk_write_block(stream->disk, stream->pos / CHUCHUOS_SECTOR_SIZE, total_sectors, ptr);
+        if (res < 0)
+        {
+            goto out;
+        }
+
+        ptr += total_sectors * CHUCHUOS_SECTOR_SIZE;
+        total -= total_sectors * CHUCHUOS_SECTOR_SIZE;
+        stream->pos += total_sectors * CHUCHUOS_SECTOR_SIZE;
     }
 
-    // Adjust the stream
-    stream->pos += total_to_read;
-    if (total > CHUCHUOS_SECTOR_SIZE)
+    // unaligned tail
+    if (total > 0)
     {
-        res = diskstreamer_read(stream, out, total-CHUCHUOS_SECTOR_SIZE);
+        res = diskstreamer_write_partial(stream, ptr, total);
     }
+
 out:
     return res;
 }
 
+int diskstreamer_flush(struct disk_stream* stream)
+{
+    stream->disk->io_class = stream->io_class;
+    return disk_queue_run(stream->disk);
+}
+
 void diskstreamer_close(struct disk_stream* stream)
 {
     kfree(stream);
+}
+
+void diskstreamer_get_stats(struct diskstreamer_stats* stats)
+{
+    *stats = diskstreamer_stats;
 }
\ No newline at end of file
@@ -5,13 +5,31 @@
 
 struct disk_stream
 {
-    int pos;
+    uint64_t pos;               // byte offset on the disk, volumes may be larger than 2 gb
     struct disk* disk;
+    DISK_IO_CLASS io_class;     // what the stream's requests count as, DISK_IO_OTHER by default
+
+    // read-ahead state
+    uint64_t last_end;          // where the previous read stopped, a read starting here is sequential
+    int readahead_window;       // sectors, 0 while the access pattern looks random
+    unsigned int readahead_end; // first sector after the last prefetch
+};
+
+// how well read-ahead pays off is counted by the buffer cache, see struct bcache_stats
+struct diskstreamer_stats
+{
+    uint32_t window_grows;
+    uint32_t window_shrinks;
 };
 
 struct disk_stream* diskstreamer_new(int disk_id);
-int diskstreamer_seek(struct disk_stream* stream, int pos);
+int diskstreamer_seek(struct disk_stream* stream, uint64_t pos);
+void diskstreamer_set_io_class(struct disk_stream* stream, DISK_IO_CLASS io_class);
 int diskstreamer_read(struct disk_stream* stream, void* out, int total);
+int diskstreamer_read_deferred(struct disk_stream* stream, void* out, int total);
+int diskstreamer_write(struct disk_stream* stream, const void* in, int total);
+int diskstreamer_flush(struct disk_stream* stream);
 void diskstreamer_close(struct disk_stream* stream);
+void diskstreamer_get_stats(struct diskstreamer_stats* stats);
 
 #endif
\ No newline at end of file
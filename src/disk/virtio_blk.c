@@ -0,0 +1,383 @@
+#include "virtio_blk.h"
+#include "disk.h"
+#include "config.h"
+#include "status.h"
+#include "io/io.h"
+#include "idt/idt.h"
+#include "pci/pci.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+#include "memory/frame/frame.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Block devices of a virtual machine through the legacy virtio pci transport. Reads are
+// added to the available ring as they come and the device is notified once per batch,
+// the used ring tells which of them are done.
+
+#define VIRTIO_PCI_VENDOR_ID    0x1AF4
+#define VIRTIO_PCI_DEVICE_BLK   0x1001  // legacy and transitional block device
+
+// legacy registers, relative to the io base in bar 0
+#define VIRTIO_REG_HOST_FEATURES    0x00
+#define VIRTIO_REG_GUEST_FEATURES   0x04
+#define VIRTIO_REG_QUEUE_PFN        0x08
+#define VIRTIO_REG_QUEUE_SIZE       0x0C
+#define VIRTIO_REG_QUEUE_SELECT     0x0E
+#define VIRTIO_REG_QUEUE_NOTIFY     0x10
+#define VIRTIO_REG_STATUS           0x12
+#define VIRTIO_REG_ISR              0x13    // reading it acknowledges the interrupt
+#define VIRTIO_REG_BLK_CAPACITY     0x14    // 64 bits, in 512 byte sectors
+
+#define VIRTIO_STATUS_ACKNOWLEDGE   (1 << 0)
+#define VIRTIO_STATUS_DRIVER        (1 << 1)
+#define VIRTIO_STATUS_DRIVER_OK     (1 << 2)
+#define VIRTIO_STATUS_FAILED        (1 << 7)
+
+#define VIRTQ_DESC_F_NEXT       (1 << 0)
+#define VIRTQ_DESC_F_WRITE      (1 << 1)    // the device writes into the buffer
+#define VIRTQ_AVAIL_F_NO_INTERRUPT  (1 << 0)
+
+#define VIRTQ_ALIGN     4096    // the used ring starts on its own page
+
+#define VIRTIO_BLK_T_IN         0
+#define VIRTIO_BLK_S_OK         0
+
+// descriptors of one read, header, data and status
+#define VIRTIO_BLK_REQUEST_DESCRIPTORS  3
+#define VIRTIO_BLK_MAX_SECTORS  65536   // no size_max is negotiated, this just bounds one descriptor
+
+// What the device reads in front of the data
+struct virtio_blk_request_header
+{
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} __attribute__((packed));
+
+// One read in flight, the device writes the status after the data
+struct virtio_blk_request
+{
+    struct virtio_blk_request_header header;
+    volatile uint8_t status;
+};
+
+// A probed device, disk->driver_private points at it
+struct virtio_blk
+{
+    unsigned short io_base;
+    uint8_t irq;
+
+    uint16_t queue_size;
+    struct virtq_desc* desc;
+    struct virtq_avail* avail;
+    volatile struct virtq_used* used;
+    struct virtio_blk_request* requests;    // indexed by the head descriptor of the read
+
+    uint16_t free_head;     // free descriptors are chained through next
+    uint16_t free_count;
+    uint16_t last_used;     // used ring entries seen so far
+    bool notify_pending;    // reads were made available since the last notify
+    int in_flight;
+    int status;             // the first error since the last virtio_blk_complete
+
+    unsigned int sectors;
+};
+
+static struct virtio_blk virtio_blk_devices[VIRTIO_BLK_MAX_DEVICES];
+static int virtio_blk_total_devices = 0;
+static bool virtio_blk_irq_enabled = false;
+
+//--------------------------------------------------------------------------------
+static void virtio_blk_barrier()
+{
+    // ring entries must be in memory before the index that publishes them
+    asm volatile("" ::: "memory");
+}
+
+//--------------------------------------------------------------------------------
+static uint32_t virtio_queue_used_offset(uint16_t queue_size)
+{
+    // descriptor table and available ring, the trailing word is the used event
+    uint32_t bytes = (sizeof(struct virtq_desc) * queue_size) + sizeof(struct virtq_avail) + (sizeof(uint16_t) * (queue_size + 1));
+    return (bytes + VIRTQ_ALIGN - 1) & ~(VIRTQ_ALIGN - 1);
+}
+
+//--------------------------------------------------------------------------------
+static uint32_t virtio_queue_bytes(uint16_t queue_size)
+{
+    uint32_t bytes = sizeof(struct virtq_used) + (sizeof(struct virtq_used_elem) * queue_size) + sizeof(uint16_t);
+    return virtio_queue_used_offset(queue_size) + ((bytes + VIRTQ_ALIGN - 1) & ~(VIRTQ_ALIGN - 1));
+}
+
+//--------------------------------------------------------------------------------
+static int virtio_blk_queue_init(struct virtio_blk* device)
+{
+    outw(device->io_base + VIRTIO_REG_QUEUE_SELECT, 0);
+    device->queue_size = insw(device->io_base + VIRTIO_REG_QUEUE_SIZE);
+    if(device->queue_size < VIRTIO_BLK_REQUEST_DESCRIPTORS)
+    {
+        return -EIO;
+    }
+
+    // the device is given the ring by frame number, so it has to be physically contiguous
+    uint32_t bytes = virtio_queue_bytes(device->queue_size);
+    char* queue = frame_alloc_contiguous(bytes / CHUCHUOS_FRAME_SIZE);
+    device->requests = kzalloc(sizeof(struct virtio_blk_request) * device->queue_size);
+    if(!queue || !device->requests)
+    {
+        return -ENOMEM;
+    }
+
+    memset(queue, 0, bytes);
+    device->desc = (struct virtq_desc*)queue;
+    device->avail = (struct virtq_avail*)(queue + (sizeof(struct virtq_desc) * device->queue_size));
+    device->used = (struct virtq_used*)(queue + virtio_queue_used_offset(device->queue_size));
+
+    for(int i = 0; i < device->queue_size; i++)
+    {
+        device->desc[i].next = i + 1;
+    }
+    device->free_head = 0;
+    device->free_count = device->queue_size;
+
+    // completion is polled until virtio_blk_enable_irq
+    device->avail->flags = VIRTQ_AVAIL_F_NO_INTERRUPT;
+
+    outl(device->io_base + VIRTIO_REG_QUEUE_PFN, (uint32_t)queue / CHUCHUOS_FRAME_SIZE);
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+int virtio_blk_probe(struct disk* disk, int index)
+{
+    struct pci_device pci_device;
+    int res = 0;
+
+    if(virtio_blk_total_devices == VIRTIO_BLK_MAX_DEVICES)
+    {
+        return -ENOMEM;
+    }
+
+    res = pci_find_device(VIRTIO_PCI_VENDOR_ID, VIRTIO_PCI_DEVICE_BLK, index, &pci_device);
+    if(res < 0)
+    {
+        return res;
+    }
+
+    uint32_t bar = pci_get_bar(&pci_device, 0);
+    if(!(bar & PCI_BAR_IO))
+    {
+        return -EIO;
+    }
+
+    struct virtio_blk* device = &virtio_blk_devices[virtio_blk_total_devices];
+    memset(device, 0, sizeof(struct virtio_blk));
+    device->io_base = bar & 0xfffc;
+    device->irq = pci_device.irq_line;
+
+    pci_enable_bus_master(&pci_device);
+
+    // reset, then announce a driver which wants none of the optional features
+    outb(device->io_base + VIRTIO_REG_STATUS, 0);
+    outb(device->io_base + VIRTIO_REG_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+    outb(device->io_base + VIRTIO_REG_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+    outl(device->io_base + VIRTIO_REG_GUEST_FEATURES, 0);
+
+    res = virtio_blk_queue_init(device);
+    if(res < 0)
+    {
+        outb(device->io_base + VIRTIO_REG_STATUS, VIRTIO_STATUS_FAILED);
+        return res;
+    }
+
+    // the 32 bit lbas of struct disk reach 2 tb, bigger devices are cut there
+    device->sectors = insl(device->io_base + VIRTIO_REG_BLK_CAPACITY);
+    if(insl(device->io_base + VIRTIO_REG_BLK_CAPACITY + 4))
+    {
+        device->sectors = 0xffffffff;
+    }
+
+    outb(device->io_base + VIRTIO_REG_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+    virtio_blk_total_devices++;
+
+    disk->read = virtio_blk_read_sectors;
+    disk->submit = virtio_blk_submit;
+    disk->complete = virtio_blk_complete;
+    disk->sectors = device->sectors;
+    disk->max_sectors = VIRTIO_BLK_MAX_SECTORS;
+    disk->driver_private = device;
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+static void virtio_blk_notify(struct virtio_blk* device)
+{
+    if(device->notify_pending)
+    {
+        outw(device->io_base + VIRTIO_REG_QUEUE_NOTIFY, 0);
+        device->notify_pending = false;
+    }
+}
+
+//--------------------------------------------------------------------------------
+static void virtio_blk_reap(struct virtio_blk* device)
+{
+    // gives the descriptors of every finished read back to the free chain
+    while(device->last_used != device->used->idx)
+    {
+        uint16_t head = device->used->ring[device->last_used % device->queue_size].id;
+
+        if(device->requests[head].status != VIRTIO_BLK_S_OK)
+        {
+            device->status = -EIO;
+        }
+
+        uint16_t tail = head;
+        while(device->desc[tail].flags & VIRTQ_DESC_F_NEXT)
+        {
+            tail = device->desc[tail].next;
+        }
+
+        device->desc[tail].next = device->free_head;
+        device->free_head = head;
+        device->free_count += VIRTIO_BLK_REQUEST_DESCRIPTORS;
+
+        device->last_used++;
+        device->in_flight--;
+    }
+}
+
+//--------------------------------------------------------------------------------
+static void virtio_blk_wait(struct virtio_blk* device)
+{
+    // until at least one more read is done
+    virtio_blk_notify(device);
+
+    if(virtio_blk_irq_enabled)
+    {
+        disable_interrupts();
+        while(device->last_used == device->used->idx)
+        {
+            wait_for_interrupt();
+            disable_interrupts();
+        }
+        enable_interrupts();
+    }
+    else
+    {
+        while(device->last_used == device->used->idx)
+        {
+        }
+    }
+
+    virtio_blk_reap(device);
+}
+
+//--------------------------------------------------------------------------------
+static uint16_t virtio_blk_take_descriptor(struct virtio_blk* device)
+{
+    uint16_t index = device->free_head;
+    device->free_head = device->desc[index].next;
+    device->free_count--;
+    return index;
+}
+
+//--------------------------------------------------------------------------------
+int virtio_blk_submit(struct disk* disk, unsigned int lba, int total, void* buf)
+{
+    // makes the read available to the device, which only hears of it on the next notify
+    struct virtio_blk* device = disk->driver_private;
+
+    while(device->free_count < VIRTIO_BLK_REQUEST_DESCRIPTORS)
+    {
+        virtio_blk_wait(device);
+    }
+
+    uint16_t head = virtio_blk_take_descriptor(device);
+    uint16_t data = virtio_blk_take_descriptor(device);
+    uint16_t status = virtio_blk_take_descriptor(device);
+
+    struct virtio_blk_request* request = &device->requests[head];
+    request->header.type = VIRTIO_BLK_T_IN;
+    request->header.reserved = 0;
+    request->header.sector = lba;
+    request->status = 0xff;
+
+    // kernel memory is identity mapped, virtual addresses are the ones the device needs
+    device->desc[head].addr = (uint32_t)&request->header;
+    device->desc[head].len = sizeof(struct virtio_blk_request_header);
+    device->desc[head].flags = VIRTQ_DESC_F_NEXT;
+    device->desc[head].next = data;
+
+    device->desc[data].addr = (uint32_t)buf;
+    device->desc[data].len = total * CHUCHUOS_SECTOR_SIZE;
+    device->desc[data].flags = VIRTQ_DESC_F_NEXT | VIRTQ_DESC_F_WRITE;
+    device->desc[data].next = status;
+
+    device->desc[status].addr = (uint32_t)&request->status;
+    device->desc[status].len = 1;
+    device->desc[status].flags = VIRTQ_DESC_F_WRITE;
+
+    device->avail->ring[device->avail->idx % device->queue_size] = head;
+    virtio_blk_barrier();
+    device->avail->idx++;
+
+    device->notify_pending = true;
+    device->in_flight++;
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+int virtio_blk_complete(struct disk* disk)
+{
+    struct virtio_blk* device = disk->driver_private;
+
+    while(device->in_flight)
+    {
+        virtio_blk_wait(device);
+    }
+
+    int res = device->status;
+    device->status = 0;
+    return res;
+}
+
+//--------------------------------------------------------------------------------
+int virtio_blk_read_sectors(struct disk* disk, unsigned int lba, int total, void* buf)
+{
+    int res = virtio_blk_submit(disk, lba, total, buf);
+    if(res < 0)
+    {
+        return res;
+    }
+
+    return virtio_blk_complete(disk);
+}
+
+//--------------------------------------------------------------------------------
+static void virtio_blk_handle_interrupt()
+{
+    // the irq line may be shared, every device acknowledges its own; the reads are reaped by
+    // whoever waits for them
+    for(int i = 0; i < virtio_blk_total_devices; i++)
+    {
+        insb(virtio_blk_devices[i].io_base + VIRTIO_REG_ISR);
+    }
+}
+
+//--------------------------------------------------------------------------------
+void virtio_blk_enable_irq()
+{
+    // only once the idt is loaded and interrupts are on, the devices are polled until then
+    for(int i = 0; i < virtio_blk_total_devices; i++)
+    {
+        struct virtio_blk* device = &virtio_blk_devices[i];
+
+        idt_register_irq_handler(device->irq, virtio_blk_handle_interrupt);
+        device->avail->flags = 0;
+        insb(device->io_base + VIRTIO_REG_ISR);
+    }
+
+    virtio_blk_irq_enabled = virtio_blk_total_devices > 0;
+}
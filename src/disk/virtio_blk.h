@@ -0,0 +1,45 @@
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include <stdint.h>
+
+#define VIRTIO_BLK_MAX_DEVICES  4
+
+// split virtqueue, as laid out by the legacy pci transport
+struct virtq_desc
+{
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed));
+
+struct virtq_avail
+{
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+} __attribute__((packed));
+
+struct virtq_used_elem
+{
+    uint32_t id;    // head descriptor of the finished chain
+    uint32_t len;
+} __attribute__((packed));
+
+struct virtq_used
+{
+    uint16_t flags;
+    uint16_t idx;
+    struct virtq_used_elem ring[];
+} __attribute__((packed));
+
+struct disk;
+
+int virtio_blk_probe(struct disk* disk, int index);
+int virtio_blk_read_sectors(struct disk* disk, unsigned int lba, int total, void* buf);
+int virtio_blk_submit(struct disk* disk, unsigned int lba, int total, void* buf);
+int virtio_blk_complete(struct disk* disk);
+void virtio_blk_enable_irq();
+
+#endif
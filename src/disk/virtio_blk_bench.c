@@ -0,0 +1,146 @@
+#include "virtio_blk_bench.h"
+#include "virtio_blk.h"
+#include "ata.h"
+#include "disk.h"
+#include "config.h"
+#include "kernel.h"
+#include "memory/heap/kheap.h"
+#include "string/string.h"
+#include "time/tsc.h"
+
+// sectors read per sequential measurement, and per request
+#define VIRTIO_BLK_BENCH_TOTAL_SECTORS      4096
+#define VIRTIO_BLK_BENCH_REQUEST_SECTORS    128
+
+// random reads of 4 kb, a batch is submitted before waiting for any of it
+#define VIRTIO_BLK_BENCH_RANDOM_READS       256
+#define VIRTIO_BLK_BENCH_RANDOM_SECTORS     8
+#define VIRTIO_BLK_BENCH_BATCH              16
+
+typedef int (*VIRTIO_BLK_BENCH_READ_FUNCTION)(struct disk* disk, unsigned int lba, int total, void* buf);
+
+static uint32_t virtio_blk_bench_seed = 1;
+
+//------------------------------------------------------------------------------------------------
+static void virtio_blk_bench_print(const char* label, uint32_t value)
+{
+    char buf[33];
+
+    print(label);
+    print(itoa(value,buf,10));
+    print("\n");
+}
+
+//------------------------------------------------------------------------------------------------
+static unsigned int virtio_blk_bench_random_lba(struct disk* disk)
+{
+    virtio_blk_bench_seed = virtio_blk_bench_seed * 1103515245 + 12345;
+    return ((virtio_blk_bench_seed >> 8) % (disk->sectors - VIRTIO_BLK_BENCH_RANDOM_SECTORS)) & ~(VIRTIO_BLK_BENCH_RANDOM_SECTORS - 1);
+}
+
+//------------------------------------------------------------------------------------------------
+static uint32_t virtio_blk_bench_sequential(struct disk* disk, VIRTIO_BLK_BENCH_READ_FUNCTION read, void* buffer)
+{
+    uint64_t start = tsc_read();
+
+    for(int lba=0; lba<VIRTIO_BLK_BENCH_TOTAL_SECTORS; lba+=VIRTIO_BLK_BENCH_REQUEST_SECTORS)
+    {
+        if(read(disk,lba,VIRTIO_BLK_BENCH_REQUEST_SECTORS,buffer) < 0)
+        {
+            return 0;
+        }
+    }
+
+    return (tsc_read() - start) / VIRTIO_BLK_BENCH_TOTAL_SECTORS;
+}
+
+//------------------------------------------------------------------------------------------------
+static uint32_t virtio_blk_bench_random(struct disk* disk, VIRTIO_BLK_BENCH_READ_FUNCTION read, void* buffer)
+{
+    // the same lbas for every device, each one reads them one after another
+    virtio_blk_bench_seed = 1;
+    uint64_t start = tsc_read();
+
+    for(int i=0; i<VIRTIO_BLK_BENCH_RANDOM_READS; i++)
+    {
+        if(read(disk,virtio_blk_bench_random_lba(disk),VIRTIO_BLK_BENCH_RANDOM_SECTORS,buffer) < 0)
+        {
+            return 0;
+        }
+    }
+
+    return (tsc_read() - start) / (VIRTIO_BLK_BENCH_RANDOM_READS * VIRTIO_BLK_BENCH_RANDOM_SECTORS);
+}
+
+//------------------------------------------------------------------------------------------------
+static uint32_t virtio_blk_bench_random_batched(struct disk* disk, char* buffer)
+{
+    // the same reads, VIRTIO_BLK_BENCH_BATCH of them are in the queue at once
+    virtio_blk_bench_seed = 1;
+    uint64_t start = tsc_read();
+
+    for(int i=0; i<VIRTIO_BLK_BENCH_RANDOM_READS; i+=VIRTIO_BLK_BENCH_BATCH)
+    {
+        for(int j=0; j<VIRTIO_BLK_BENCH_BATCH; j++)
+        {
+            char* buf = buffer + (j * VIRTIO_BLK_BENCH_RANDOM_SECTORS * CHUCHUOS_SECTOR_SIZE);
+            if(virtio_blk_submit(disk,virtio_blk_bench_random_lba(disk),VIRTIO_BLK_BENCH_RANDOM_SECTORS,buf) < 0)
+            {
+                return 0;
+            }
+        }
+
+        if(virtio_blk_complete(disk) < 0)
+        {
+            return 0;
+        }
+    }
+
+    return (tsc_read() - start) / (VIRTIO_BLK_BENCH_RANDOM_READS * VIRTIO_BLK_BENCH_RANDOM_SECTORS);
+}
+
+//------------------------------------------------------------------------------------------------
+void virtio_blk_benchmark()
+{
+    // compares the first virtio disk with pio reads from the first ata disk, in cycles per sector
+    struct disk* virtio_disk = 0;
+    struct disk* ata_disk = 0;
+
+    for(int i=0; disk_get(i); i++)
+    {
+        struct disk* disk = disk_get(i);
+        if(!virtio_disk && disk->type == CHUCHUOS_DISK_TYPE_VIRTIO)
+        {
+            virtio_disk = disk;
+        }
+
+        if(!ata_disk && disk->type == CHUCHUOS_DISK_TYPE_REAL)
+        {
+            ata_disk = disk;
+        }
+    }
+
+    if(!virtio_disk)
+    {
+        print("virtio: no block device\n");
+        return;
+    }
+
+    void* buffer = kmalloc(VIRTIO_BLK_BENCH_REQUEST_SECTORS * CHUCHUOS_SECTOR_SIZE);
+    if(!buffer)
+    {
+        return;
+    }
+
+    if(ata_disk)
+    {
+        virtio_blk_bench_print("ata: pio sequential cycles/sector: ",virtio_blk_bench_sequential(ata_disk,ata_read_sectors_pio,buffer));
+        virtio_blk_bench_print("ata: pio random cycles/sector: ",virtio_blk_bench_random(ata_disk,ata_read_sectors_pio,buffer));
+    }
+
+    virtio_blk_bench_print("virtio: sequential cycles/sector: ",virtio_blk_bench_sequential(virtio_disk,virtio_blk_read_sectors,buffer));
+    virtio_blk_bench_print("virtio: random cycles/sector: ",virtio_blk_bench_random(virtio_disk,virtio_blk_read_sectors,buffer));
+    virtio_blk_bench_print("virtio: random batched cycles/sector: ",virtio_blk_bench_random_batched(virtio_disk,buffer));
+
+    kfree(buffer);
+}
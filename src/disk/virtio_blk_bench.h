@@ -0,0 +1,6 @@
+#ifndef VIRTIO_BLK_BENCH_H
+#define VIRTIO_BLK_BENCH_H
+
+void virtio_blk_benchmark();
+
+#endif
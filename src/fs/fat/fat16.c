@@ -2,6 +2,7 @@
 #include "string/string.h"
 #include "status.h"
 #include <stdint.h>
+#include <stdbool.h>
 #include "disk/disk.h"
 #include "disk/streamer.h"
 #include "memory/memory.h"
@@ -11,8 +12,12 @@
 
 #define CHUCHUOS_FAT16_SIGNATURE 0x29
 #define CHUCHUOS_FAT16_FAT_ENTRY_SIZE 0x02
-#define CHUCHUOS_FAT16_BAD_SECTOR 0xFF7
+#define CHUCHUOS_FAT16_BAD_SECTOR 0xFFF7
+#define CHUCHUOS_FAT16_RESERVED_CLUSTER 0xFFF0   // 0xFFF0 to 0xFFF6 are reserved values
 #define CHUCHUOS_FAT16_UNUSED 0x00
+#define CHUCHUOS_FAT16_END_OF_CHAIN 0xFFF8  // entries from here on end a cluster chain
+#define CHUCHUOS_FAT16_LAST_CLUSTER 0xFFFF  // what a newly allocated cluster is marked with
+#define CHUCHUOS_FAT16_UNKNOWN_POS ((uint64_t)-1)
 
 typedef unsigned int FAT_ITEM_TYPE;
 #define FAT_ITEM_TYPE_DIRECTORY 0
@@ -92,8 +97,9 @@ struct fat_directory
 {
     struct fat_directory_item* item;
     int total;
-    int sector_pos;
-    int ending_sector_pos;
+    uint32_t sector_pos;
+    uint32_t ending_sector_pos;
+    int first_cluster;  // 0 for the root directory, which sits outside the data clusters
 };
 
 //--------------------------------------------
@@ -106,6 +112,19 @@ struct fat_item
     };
 
     FAT_ITEM_TYPE type;
+
+    // byte position of the item's directory entry on the disk, CHUCHUOS_FAT16_UNKNOWN_POS when unknown
+    uint64_t directory_entry_pos;
+};
+
+//--------------------------------------------
+// A cluster of a chain and its index in it, so the next lookup further down the
+// chain does not have to start at the first cluster again
+struct fat_chain_position
+{
+    int first_cluster;      // chain the position belongs to
+    uint32_t index;
+    int cluster;            // 0 when nothing is remembered
 };
 
 //--------------------------------------------
@@ -113,6 +132,11 @@ struct fat_file_descriptor
 {
     struct fat_item* item;
     uint32_t pos;
+    struct fat_chain_position position;
+
+    struct disk* disk;
+    FILE_MODE mode;
+    bool dirty;     // size or first cluster changed, the directory entry is behind
 };
 
 //---------------------------------------------
@@ -130,13 +154,24 @@ struct fat_private
     // Stream the director
     struct disk_stream* directory_stream;
 
+    // data clusters of the volume, and where the search for a free one goes on
+    uint32_t total_clusters;
+    uint32_t next_free_cluster;
+
+    // the first copy of the table, entries are looked up here instead of on the disk
+    uint16_t* fat_table;
+    uint32_t fat_table_entries;
+    bool* fat_sector_loaded;    // per table sector, 0 when the whole table was read at resolve
 };
 
 
 
 int fat16_resolve(struct disk* disk);
+uint64_t fat16_sector_to_absolute(struct disk* disk, uint32_t sector_no);
 void* fat16_open(struct disk* disk, struct path_part* path, FILE_MODE mode );
 int fat16_read(struct disk* disk, void* descriptor, uint32_t size, uint32_t nmemb, char* out_ptr);
+int fat16_write(struct disk* disk, void* descriptor, uint32_t size, uint32_t nmemb, const char* in_ptr);
+int fat16_flush(struct disk* disk, void* private);
 int fat16_seek(void* private, uint32_t offset, FILE_SEEK_MODE seek_mode);
 int fat16_stat(struct disk* disk, void* private, struct file_stat* stat);
 int fat16_close(void* private);
@@ -147,6 +182,8 @@ struct filesystem fat16_fs =
     .resolve = fat16_resolve,
     .open = fat16_open,
     .read = fat16_read,
+    .write = fat16_write,
+    .flush = fat16_flush,
     .seek = fat16_seek,
     .stat = fat16_stat,
     .close = fat16_close     
@@ -168,6 +205,11 @@ static void fat16_init_private(struct disk* disk, struct fat_private* private)
     private->cluster_read_stream = diskstreamer_new(disk->id);
     private->directory_stream = diskstreamer_new(disk->id);
     private->fat_read_stream = diskstreamer_new(disk->id);
+
+    // the disk layer counts what each of them pulls
+    diskstreamer_set_io_class(private->cluster_read_stream,DISK_IO_DATA);
+    diskstreamer_set_io_class(private->directory_stream,DISK_IO_DIRECTORY);
+    diskstreamer_set_io_class(private->fat_read_stream,DISK_IO_FAT);
 }
 
 //----------------------------------------------------------------------------
@@ -180,7 +222,7 @@ int fat16_get_total_items_of_directory_from_disk(struct disk* disk, uint32_t dir
    int res = 0;
    int counter = 0;
 
-   int directory_start_pos = directory_start_sector * disk->sector_size;
+   uint64_t directory_start_pos = fat16_sector_to_absolute(disk,directory_start_sector);
    struct disk_stream* stream = fat_private->directory_stream;
 
    if(diskstreamer_seek(stream, directory_start_pos) != CHUCHUOS_ALL_OK)
@@ -220,9 +262,10 @@ out:
 
 //-----------------------------------------------------------------------------
 
-int fat16_sector_to_absolute(struct disk* disk, int sector_no)
+uint64_t fat16_sector_to_absolute(struct disk* disk, uint32_t sector_no)
 {
-    return sector_no* disk->sector_size;
+    // past 2 gb of a volume a byte offset no longer fits an int
+    return (uint64_t)sector_no * disk->sector_size;
 }
 
 
@@ -268,21 +311,116 @@ int fat16_get_root_directory(struct disk* disk, struct fat_private* fat_private,
     }
 
     directory->item = dir;
+    dir = 0;
     directory->total = total_items;
     directory->sector_pos = root_dir_sector_pos;
     directory->ending_sector_pos = root_dir_sector_pos + (root_dir_size / disk->sector_size);
 
 out:
+    if(dir)
+    {
+        kfree(dir);
+    }
+
     return res;
 
 }
 
+//----------------------------------------------------------------------------
+static int fat16_load_fat_sector(struct disk* disk, struct fat_private* fat_private, uint32_t sector)
+{
+    int res = 0;
+    struct disk_stream* stream = fat_private->fat_read_stream;
+    uint32_t fat_table_position = (fat_private->header.primary_header.reserved_sectors + sector) * disk->sector_size;
+
+    res = diskstreamer_seek(stream,fat_table_position);
+    if(res < 0)
+    {
+        goto out;
+    }
+
+    res = diskstreamer_read(stream,(char*)fat_private->fat_table + (sector * disk->sector_size),disk->sector_size);
+    if(res < 0)
+    {
+        goto out;
+    }
+
+    fat_private->fat_sector_loaded[sector] = true;
+
+out:
+    return res;
+}
+
+//----------------------------------------------------------------------------
+static int fat16_load_fat_table(struct disk* disk, struct fat_private* fat_private)
+{
+    // the first copy of the table goes into memory with one read, a table too big for that
+    // only gets its memory here and is filled in by fat16_load_fat_sector
+    int res = 0;
+    struct disk_stream* stream = fat_private->fat_read_stream;
+    struct fat_header* primary_header = &fat_private->header.primary_header;
+    uint32_t fat_size = primary_header->sectors_per_fat * disk->sector_size;
+
+    if(!stream)
+    {
+        res = -EIO;
+        goto out;
+    }
+
+    fat_private->fat_table = kzalloc(fat_size);
+    if(!fat_private->fat_table)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    if(primary_header->sectors_per_fat > CHUCHUOS_FAT16_FAT_PRELOAD_MAX_SECTORS)
+    {
+        fat_private->fat_sector_loaded = kzalloc(primary_header->sectors_per_fat * sizeof(bool));
+        if(!fat_private->fat_sector_loaded)
+        {
+            res = -ENOMEM;
+            goto out;
+        }
+    }
+    else
+    {
+        res = diskstreamer_seek(stream,primary_header->reserved_sectors * disk->sector_size);
+        if(res < 0)
+        {
+            goto out;
+        }
+
+        res = diskstreamer_read(stream,fat_private->fat_table,fat_size);
+        if(res < 0)
+        {
+            goto out;
+        }
+    }
+
+    fat_private->fat_table_entries = fat_size / CHUCHUOS_FAT16_FAT_ENTRY_SIZE;
+
+out:
+    if(res < 0 && fat_private->fat_table)
+    {
+        kfree(fat_private->fat_table);
+        fat_private->fat_table = 0;
+    }
+
+    return res;
+}
+
 //----------------------------------------------------------------------------
 int fat16_resolve(struct disk* disk)
 {
     int res = 0;
 
     struct fat_private* fat_private = kzalloc(sizeof(struct fat_private));
+    if(!fat_private)
+    {
+        return -ENOMEM;
+    }
+
     fat16_init_private(disk,fat_private);
 
     disk->fs_private = fat_private;
@@ -316,6 +454,25 @@ int fat16_resolve(struct disk* disk)
         goto out;
     }
 
+    // the clusters after the root directory, as far as the table has entries for them
+    struct fat_header* primary_header = &fat_private->header.primary_header;
+    uint32_t total_sectors = primary_header->number_of_sectors ? primary_header->number_of_sectors : primary_header->sectors_big;
+    uint32_t fat_entries = (primary_header->sectors_per_fat * disk->sector_size) / CHUCHUOS_FAT16_FAT_ENTRY_SIZE;
+
+    fat_private->total_clusters = (total_sectors - fat_private->root_directory.ending_sector_pos) / primary_header->sectors_per_cluster;
+    if(fat_private->total_clusters > fat_entries - 2)
+    {
+        fat_private->total_clusters = fat_entries - 2;
+    }
+    fat_private->next_free_cluster = 2;
+
+    res = fat16_load_fat_table(disk,fat_private);
+    if(res == -ENOMEM)
+    {
+        // entries are then read from the disk each time
+        res = 0;
+    }
+
 out:
     if(stream)
     {
@@ -324,6 +481,32 @@ out:
 
     if(res < 0)
     {
+        if(fat_private->fat_table)
+        {
+            kfree(fat_private->fat_table);
+        }
+        if(fat_private->fat_sector_loaded)
+        {
+            kfree(fat_private->fat_sector_loaded);
+        }
+        if(fat_private->root_directory.item)
+        {
+            kfree(fat_private->root_directory.item);
+        }
+
+        // every disk is probed, so a volume which is not ours must not leave anything behind
+        if(fat_private->cluster_read_stream)
+        {
+            diskstreamer_close(fat_private->cluster_read_stream);
+        }
+        if(fat_private->directory_stream)
+        {
+            diskstreamer_close(fat_private->directory_stream);
+        }
+        if(fat_private->fat_read_stream)
+        {
+            diskstreamer_close(fat_private->fat_read_stream);
+        }
         kfree(fat_private);
         disk->fs_private = 0;
     }
@@ -395,7 +578,7 @@ static uint32_t fat16_get_first_cluster(struct fat_directory_item* item)
 }
 
 //-----------------------------------------------------------------------------
-static int fat16_cluster_to_sector(struct fat_private* fat_private,int cluster)
+static uint32_t fat16_cluster_to_sector(struct fat_private* fat_private,int cluster)
 {
     return fat_private->root_directory.ending_sector_pos + ( (cluster-2)*fat_private->header.primary_header.sectors_per_cluster) ;
 }
@@ -412,6 +595,29 @@ static int fat16_get_entry_from_fat_table(struct disk* disk, int cluster)
     int res = -1;
     struct fat_private* fat_private = disk->fs_private;
     struct disk_stream* stream = fat_private->fat_read_stream;
+
+    if(fat_private->fat_table)
+    {
+        if(cluster < 0 || (uint32_t)cluster >= fat_private->fat_table_entries)
+        {
+            res = -EINVARG;
+            goto out;
+        }
+
+        uint32_t sector = (cluster * CHUCHUOS_FAT16_FAT_ENTRY_SIZE) / disk->sector_size;
+        if(fat_private->fat_sector_loaded && !fat_private->fat_sector_loaded[sector])
+        {
+            res = fat16_load_fat_sector(disk,fat_private,sector);
+            if(res < 0)
+            {
+                goto out;
+            }
+        }
+
+        res = fat_private->fat_table[cluster];
+        goto out;
+    }
+
     if(!stream)
     {
         goto out;
@@ -440,20 +646,144 @@ out:
 
 
 //-----------------------------------------------------------------------------
-static int fat_get_offseted_cluster(struct disk* disk, int starting_cluster, int offset)
+static int fat16_set_entry_in_fat_table(struct disk* disk, int cluster, uint16_t value)
+{
+    // every copy of the table gets the same entry
+    int res = 0;
+    struct fat_private* fat_private = disk->fs_private;
+    struct fat_header* primary_header = &fat_private->header.primary_header;
+    struct disk_stream* stream = fat_private->fat_read_stream;
+
+    for(int i=0; i<primary_header->fat_copies; i++)
+    {
+        uint32_t fat_table_position = (fat16_get_first_fat_sector(fat_private) + (i * primary_header->sectors_per_fat)) * disk->sector_size;
+
+        res = diskstreamer_seek(stream,fat_table_position + (cluster*CHUCHUOS_FAT16_FAT_ENTRY_SIZE));
+        if(res < 0)
+        {
+            goto out;
+        }
+
+        res = diskstreamer_write(stream,&value,sizeof(value));
+        if(res < 0)
+        {
+            goto out;
+        }
+    }
+
+    // a sector of a lazily loaded table that is not in memory yet is read with the new entry later
+    if(fat_private->fat_table && cluster >= 0 && (uint32_t)cluster < fat_private->fat_table_entries)
+    {
+        fat_private->fat_table[cluster] = value;
+    }
+
+out:
+    return res;
+}
+
+//-----------------------------------------------------------------------------
+static int fat16_allocate_cluster(struct disk* disk, int previous_cluster)
+{
+    // the next free cluster from where the last search stopped, it becomes the end of the
+    // chain of previous_cluster, or of a new chain when that is 0
+    int res = 0;
+    struct fat_private* fat_private = disk->fs_private;
+
+    for(uint32_t i=0; i<fat_private->total_clusters; i++)
+    {
+        int cluster = 2 + ((fat_private->next_free_cluster - 2 + i) % fat_private->total_clusters);
+
+        int entry = fat16_get_entry_from_fat_table(disk,cluster);
+        if(entry < 0)
+        {
+            res = entry;
+            goto out;
+        }
+
+        if(entry != CHUCHUOS_FAT16_UNUSED)
+        {
+            continue;
+        }
+
+        res = fat16_set_entry_in_fat_table(disk,cluster,CHUCHUOS_FAT16_LAST_CLUSTER);
+        if(res < 0)
+        {
+            goto out;
+        }
+
+        if(previous_cluster)
+        {
+            res = fat16_set_entry_in_fat_table(disk,previous_cluster,cluster);
+            if(res < 0)
+            {
+                goto out;
+            }
+        }
+
+        fat_private->next_free_cluster = cluster + 1;
+        if(fat_private->next_free_cluster >= fat_private->total_clusters + 2)
+        {
+            fat_private->next_free_cluster = 2;
+        }
+
+        res = cluster;
+        goto out;
+    }
+
+    res = -ENOSPC;
+
+out:
+    return res;
+}
+
+//-----------------------------------------------------------------------------
+static int fat16_free_chain(struct disk* disk, int cluster)
 {
     int res = 0;
     struct fat_private* fat_private = disk->fs_private;
-    int bytes_per_cluster = fat_private->header.primary_header.sectors_per_cluster * disk->sector_size;
-    int cluster_to_use = starting_cluster;
-    int no_of_clusters_ahead = offset / bytes_per_cluster;
 
-    for(int i=0; i<no_of_clusters_ahead;i++)
+    while(cluster >= 2 && cluster < CHUCHUOS_FAT16_END_OF_CHAIN)
     {
-        // need function to read fat entry
-        int entry = fat16_get_entry_from_fat_table(disk,cluster_to_use);
+        int next = fat16_get_entry_from_fat_table(disk,cluster);
+        if(next < 0)
+        {
+            res = next;
+            break;
+        }
 
-        if(entry == 0xFF8 || entry == 0xFFF)
+        res = fat16_set_entry_in_fat_table(disk,cluster,CHUCHUOS_FAT16_UNUSED);
+        if(res < 0)
+        {
+            break;
+        }
+
+        if(cluster < fat_private->next_free_cluster)
+        {
+            fat_private->next_free_cluster = cluster;
+        }
+
+        cluster = next;
+    }
+
+    return res;
+}
+
+//-----------------------------------------------------------------------------
+static int fat16_walk_chain(struct disk* disk, int cluster, uint32_t clusters_ahead)
+{
+    int res = 0;
+    struct fat_private* fat_private = disk->fs_private;
+
+    for(uint32_t i=0; i<clusters_ahead; i++)
+    {
+        int entry = fat16_get_entry_from_fat_table(disk,cluster);
+        if(entry < 0)
+        {
+            res = entry;
+            goto out;
+        }
+
+        if(entry >= CHUCHUOS_FAT16_END_OF_CHAIN)
         {   // this is the last entry
             res = -EIO;
             goto out;
@@ -465,65 +795,250 @@ static int fat_get_offseted_cluster(struct disk* disk, int starting_cluster, int
             goto out;
         }
 
-        if(entry == 0xFF0 || entry == 0xFF6)
+        if(entry >= CHUCHUOS_FAT16_RESERVED_CLUSTER)
         {
             res = -EIO;
             goto out;
         }
 
-        if(entry == 0x00)
+        if(entry < 2 || (uint32_t)entry > fat_private->total_clusters + 1)
         {
+            // free, or past the clusters of the volume
             res = -EIO;
             goto out;
         }
 
-        cluster_to_use = entry;
+        cluster = entry;
     }
-    
-    res = cluster_to_use;
 
-out: 
+    res = cluster;
+
+out:
     return res;
 }
 
 //-----------------------------------------------------------------------------
-static int fat16_retrieve_data_from_stream(struct disk* disk, struct disk_stream* stream, int starting_cluster, int offset, int total, void* out_buf)
+static int fat_get_offseted_cluster(struct disk* disk, int starting_cluster, int offset)
+{
+    struct fat_private* fat_private = disk->fs_private;
+    int bytes_per_cluster = fat_private->header.primary_header.sectors_per_cluster * disk->sector_size;
+    return fat16_walk_chain(disk,starting_cluster,offset / bytes_per_cluster);
+}
+
+//-----------------------------------------------------------------------------
+static int fat16_get_cluster_at_position(struct disk* disk, int starting_cluster, struct fat_chain_position* position, int offset)
+{
+    // resumes from the remembered cluster when the offset is not before it
+    struct fat_private* fat_private = disk->fs_private;
+    int bytes_per_cluster = fat_private->header.primary_header.sectors_per_cluster * disk->sector_size;
+    uint32_t index = offset / bytes_per_cluster;
+    int cluster = starting_cluster;
+    uint32_t clusters_ahead = index;
+
+    if(position->cluster && position->first_cluster == starting_cluster && position->index <= index)
+    {
+        cluster = position->cluster;
+        clusters_ahead = index - position->index;
+    }
+
+    cluster = fat16_walk_chain(disk,cluster,clusters_ahead);
+    if(cluster < 0)
+    {
+        position->cluster = 0;
+        return cluster;
+    }
+
+    position->first_cluster = starting_cluster;
+    position->index = index;
+    position->cluster = cluster;
+
+    return cluster;
+}
+
+//-----------------------------------------------------------------------------
+static int fat16_retrieve_data_from_stream(struct disk* disk, struct disk_stream* stream, int starting_cluster, struct fat_chain_position* position, int offset, int total, void* out_buf)
 {
     int res = 0;
     struct fat_private* fat_private = disk->fs_private;
 
+    // without one from the caller the position still saves walking the chain once per cluster
+    struct fat_chain_position local_position = {0};
+    if(!position)
+    {
+        position = &local_position;
+    }
+
     int size_of_cluster_bytes = fat_private->header.primary_header.sectors_per_cluster * disk->sector_size;
 
-    int cluster_to_use = fat_get_offseted_cluster(disk,starting_cluster,offset);
+    // the clusters are only queued, so the disk queue can merge neighbouring ones into one read
+    while(total > 0)
+    {
+        int cluster_to_use = fat16_get_cluster_at_position(disk,starting_cluster,position,offset);
+
+        if(cluster_to_use < 0)
+        {
+            res = cluster_to_use;
+            goto out;
+        }
+
+        int offset_from_cluster = offset % size_of_cluster_bytes;
+
+        uint32_t starting_sector = fat16_cluster_to_sector(fat_private,cluster_to_use);
+        uint64_t starting_position = fat16_sector_to_absolute(disk,starting_sector) + offset_from_cluster;
+
+        int total_to_read = size_of_cluster_bytes - offset_from_cluster;
+        if(total_to_read > total)
+        {
+            total_to_read = total;
+        }
+
+        res = diskstreamer_seek(stream,starting_position);
+
+        if(res != CHUCHUOS_ALL_OK)
+        {
+            goto out;
+        } 
+
+        res = diskstreamer_read_deferred(stream,out_buf,total_to_read);
+        if(res < 0)
+        {
+            goto out;
+        }
+
+        total -= total_to_read;
+        offset += total_to_read;
+        out_buf += total_to_read;
+    }
 
-    if(cluster_to_use < 0)
+out:
+    // queued reads point into out_buf, they have to be done before we return
+    if(diskstreamer_flush(stream) < 0 && res >= 0)
     {
-        res = cluster_to_use;
-        goto out;
+        res = -EIO;
     }
 
-    int offset_from_cluster = offset % size_of_cluster_bytes;
+    return res;
+}
+
+//-----------------------------------------------------------------------------
+static int fat16_retrieve_data(struct disk* disk, struct fat_file_descriptor* descriptor, int offset, int total, void* out_buf)
+{
+    struct fat_private* fat_private = disk->fs_private;
+    struct disk_stream* stream = fat_private->cluster_read_stream;
+    int starting_cluster = fat16_get_first_cluster(descriptor->item->item);
+    return fat16_retrieve_data_from_stream(disk,stream,starting_cluster,&descriptor->position,offset,total,out_buf);
+}
+
+//-----------------------------------------------------------------------------
+static int fat16_get_cluster_for_write(struct disk* disk, struct fat_file_descriptor* descriptor, int offset)
+{
+    // like fat16_get_cluster_at_position, but the chain grows where it ends
+    struct fat_private* fat_private = disk->fs_private;
+    struct fat_directory_item* item = descriptor->item->item;
+    struct fat_chain_position* position = &descriptor->position;
+    int bytes_per_cluster = fat_private->header.primary_header.sectors_per_cluster * disk->sector_size;
+    uint32_t index = offset / bytes_per_cluster;
+    int cluster = fat16_get_first_cluster(item);
+    uint32_t i = 0;
 
-    int starting_sector = fat16_cluster_to_sector(fat_private,cluster_to_use);
-    int starting_position = (starting_sector * disk->sector_size) + offset_from_cluster;
+    if(cluster == 0)
+    {
+        // an empty file has no chain yet
+        cluster = fat16_allocate_cluster(disk,0);
+        if(cluster < 0)
+        {
+            return cluster;
+        }
 
-    int total_to_read = total > size_of_cluster_bytes ? size_of_cluster_bytes : total;
+        item->low_16_bits_first_cluster = cluster;
+        item->high_16_bits_first_cluster = 0;
+        descriptor->dirty = true;
+    }
 
-    res = diskstreamer_seek(stream,starting_position);
+    if(position->cluster && position->first_cluster == cluster && position->index <= index)
+    {
+        cluster = position->cluster;
+        i = position->index;
+    }
 
-    if(res != CHUCHUOS_ALL_OK)
+    for(; i<index; i++)
     {
-        goto out;
-    } 
+        int entry = fat16_get_entry_from_fat_table(disk,cluster);
+        if(entry < 0)
+        {
+            position->cluster = 0;
+            return entry;
+        }
 
-    res = diskstreamer_read(stream,out_buf,total_to_read);
+        if(entry >= CHUCHUOS_FAT16_END_OF_CHAIN)
+        {
+            entry = fat16_allocate_cluster(disk,cluster);
+            if(entry < 0)
+            {
+                position->cluster = 0;
+                return entry;
+            }
+        }
+        else if(entry < 2 || (uint32_t)entry > fat_private->total_clusters + 1 || entry >= CHUCHUOS_FAT16_RESERVED_CLUSTER)
+        {
+            // free, reserved or bad, not something a chain may lead to
+            position->cluster = 0;
+            return -EIO;
+        }
+
+        cluster = entry;
+    }
+
+    position->first_cluster = fat16_get_first_cluster(item);
+    position->index = index;
+    position->cluster = cluster;
 
-    total -= total_to_read;
+    return cluster;
+}
+
+//-----------------------------------------------------------------------------
+static int fat16_store_data(struct disk* disk, struct fat_file_descriptor* descriptor, int offset, int total, const char* in_buf)
+{
+    int res = 0;
+    struct fat_private* fat_private = disk->fs_private;
+    struct disk_stream* stream = fat_private->cluster_read_stream;
 
-    if(total > 0)
+    int size_of_cluster_bytes = fat_private->header.primary_header.sectors_per_cluster * disk->sector_size;
+
+    while(total > 0)
     {
-        // we still have more data to read
-        res = fat16_retrieve_data_from_stream(disk,stream,starting_cluster,offset+total_to_read,total,out_buf+total_to_read);
+        int cluster_to_use = fat16_get_cluster_for_write(disk,descriptor,offset);
+        if(cluster_to_use < 0)
+        {
+            res = cluster_to_use;
+            goto out;
+        }
+
+        int offset_from_cluster = offset % size_of_cluster_bytes;
+        uint32_t starting_sector = fat16_cluster_to_sector(fat_private,cluster_to_use);
+        uint64_t starting_position = fat16_sector_to_absolute(disk,starting_sector) + offset_from_cluster;
+
+        int total_to_write = size_of_cluster_bytes - offset_from_cluster;
+        if(total_to_write > total)
+        {
+            total_to_write = total;
+        }
+
+        res = diskstreamer_seek(stream,starting_position);
+        if(res != CHUCHUOS_ALL_OK)
+        {
+            goto out;
+        }
+
+        res = diskstreamer_write(stream,in_buf,total_to_write);
+        if(res < 0)
+        {
+            goto out;
+        }
+
+        total -= total_to_write;
+        offset += total_to_write;
+        in_buf += total_to_write;
     }
 
 out:
@@ -531,11 +1046,42 @@ out:
 }
 
 //-----------------------------------------------------------------------------
-static int fat16_retrieve_data(struct disk* disk, int starting_cluster, int offset, int total, void* out_buf)
+static int fat16_write_directory_item(struct disk* disk, struct fat_item* fat_item)
 {
+    // the entry goes back to where it was read from
+    int res = 0;
     struct fat_private* fat_private = disk->fs_private;
-    struct disk_stream* stream = fat_private->cluster_read_stream;
-    return fat16_retrieve_data_from_stream(disk,stream,starting_cluster,offset,total,out_buf);
+    struct fat_directory* root = &fat_private->root_directory;
+    uint64_t pos = fat_item->directory_entry_pos;
+
+    if(pos == CHUCHUOS_FAT16_UNKNOWN_POS)
+    {
+        res = -EIO;
+        goto out;
+    }
+
+    res = diskstreamer_seek(fat_private->directory_stream,pos);
+    if(res < 0)
+    {
+        goto out;
+    }
+
+    res = diskstreamer_write(fat_private->directory_stream,fat_item->item,sizeof(struct fat_directory_item));
+    if(res < 0)
+    {
+        goto out;
+    }
+
+    // the root directory is looked up in its copy from fat16_resolve, which has to follow
+    uint64_t root_start = fat16_sector_to_absolute(disk,root->sector_pos);
+    uint64_t root_end = fat16_sector_to_absolute(disk,root->ending_sector_pos);
+    if(pos >= root_start && pos < root_end)
+    {
+        memcpy(&root->item[(uint32_t)(pos - root_start) / sizeof(struct fat_directory_item)],fat_item->item,sizeof(struct fat_directory_item));
+    }
+
+out:
+    return res;
 }
 
 //-----------------------------------------------------------------------------
@@ -590,10 +1136,12 @@ struct fat_directory* fat16_load_fat_directory(struct disk* disk, struct fat_dir
     }
 
     int first_cluster_of_item = fat16_get_first_cluster(item);
-    int first_sector_of_item = fat16_cluster_to_sector(fat_private,first_cluster_of_item);
+    uint32_t first_sector_of_item = fat16_cluster_to_sector(fat_private,first_cluster_of_item);
     int total_items_in_dir = fat16_get_total_items_of_directory_from_disk(disk,first_sector_of_item);
 
     fat_directory->total = total_items_in_dir;
+    fat_directory->sector_pos = first_sector_of_item;
+    fat_directory->first_cluster = first_cluster_of_item;
 
     int directory_size = (fat_directory->total)*sizeof(struct fat_directory_item);
 
@@ -604,7 +1152,8 @@ struct fat_directory* fat16_load_fat_directory(struct disk* disk, struct fat_dir
         goto out;
     }
 
-    res = fat16_retrieve_data(disk,first_cluster_of_item,0x00,directory_size,fat_directory->item);
+    // a subdirectory is read like a file, but counts as directory traffic
+    res = fat16_retrieve_data_from_stream(disk,fat_private->directory_stream,first_cluster_of_item,0,0x00,directory_size,fat_directory->item);
     if(res != CHUCHUOS_ALL_OK)
     {
         goto out;
@@ -642,6 +1191,28 @@ struct fat_item* fat16_create_new_fat_item_for_directory_item(struct disk* disk,
 
 }
 
+//-----------------------------------------------------------------------------
+static uint64_t fat16_get_directory_entry_pos(struct disk* disk, struct fat_directory* fat_directory, int index)
+{
+    struct fat_private* fat_private = disk->fs_private;
+    int offset = index * sizeof(struct fat_directory_item);
+
+    if(fat_directory->first_cluster == 0)
+    {
+        return fat16_sector_to_absolute(disk,fat_directory->sector_pos) + offset;
+    }
+
+    // a subdirectory is a cluster chain like any file
+    int bytes_per_cluster = fat_private->header.primary_header.sectors_per_cluster * disk->sector_size;
+    int cluster = fat_get_offseted_cluster(disk,fat_directory->first_cluster,offset);
+    if(cluster < 0)
+    {
+        return CHUCHUOS_FAT16_UNKNOWN_POS;
+    }
+
+    return fat16_sector_to_absolute(disk,fat16_cluster_to_sector(fat_private,cluster)) + (offset % bytes_per_cluster);
+}
+
 //-----------------------------------------------------------------------------
 struct fat_item* fat16_get_path_item_from_directory(struct disk* disk, struct fat_directory* fat_directory, const char* name)
 {
@@ -655,8 +1226,14 @@ struct fat_item* fat16_get_path_item_from_directory(struct disk* disk, struct fa
 
         if(istrncmp(temp_filename,name,sizeof(temp_filename))==0)
         {
-            // we found a match, now create a new fat item
+            // we found a match, now create a new fat item. Names are unique within a
+            // directory, so stop here instead of allocating (and leaking) more items
             fat_item = fat16_create_new_fat_item_for_directory_item(disk,&fat_directory->item[i]);
+            if(fat_item)
+            {
+                fat_item->directory_entry_pos = fat16_get_directory_entry_pos(disk,fat_directory,i);
+            }
+            break;
         }
     }
 
@@ -698,13 +1275,54 @@ out:
 }
 
 //-----------------------------------------------------------------------------
-void* fat16_open(struct disk* disk, struct path_part* path, FILE_MODE mode)
+static void fat16_free_file_descriptor(struct fat_file_descriptor* descriptor);
+
+//-----------------------------------------------------------------------------
+static int fat16_open_for_write(struct disk* disk, struct fat_file_descriptor* descriptor)
 {
-    if(mode != FILE_MODE_READ)
+    // only files which exist already, "w" cuts them to nothing and "a" goes to their end
+    int res = 0;
+
+    if(descriptor->item->type != FAT_ITEM_TYPE_FILE)
     {
-        return ERROR(ERDONLY);
+        res = -EINVARG;
+        goto out;
     }
 
+    struct fat_directory_item* item = descriptor->item->item;
+    if(!disk->write || (item->attribute & FAT_FILE_READONLY))
+    {
+        res = -ERDONLY;
+        goto out;
+    }
+
+    if(descriptor->mode == FILE_MODE_APPEND)
+    {
+        descriptor->pos = item->filesize;
+        goto out;
+    }
+
+    res = fat16_free_chain(disk,fat16_get_first_cluster(item));
+    if(res < 0)
+    {
+        goto out;
+    }
+
+    item->low_16_bits_first_cluster = 0;
+    item->high_16_bits_first_cluster = 0;
+    item->filesize = 0;
+    descriptor->position.cluster = 0;
+
+    // the freed clusters must not stay reachable from the entry
+    res = fat16_write_directory_item(disk,descriptor->item);
+
+out:
+    return res;
+}
+
+//-----------------------------------------------------------------------------
+void* fat16_open(struct disk* disk, struct path_part* path, FILE_MODE mode)
+{
     struct fat_file_descriptor* descriptor = 0;
 
     descriptor = kzalloc(sizeof(struct fat_file_descriptor));
@@ -716,10 +1334,24 @@ void* fat16_open(struct disk* disk, struct path_part* path, FILE_MODE mode)
     descriptor->item = fat16_get_final_file_from_directory(disk,path);
     if(!descriptor->item)
     {
+        kfree(descriptor);
         return ERROR(-EIO);
     }
 
     descriptor->pos = 0;
+    descriptor->disk = disk;
+    descriptor->mode = mode;
+
+    if(mode != FILE_MODE_READ)
+    {
+        int res = fat16_open_for_write(disk,descriptor);
+        if(res < 0)
+        {
+            fat16_free_file_descriptor(descriptor);
+            return ERROR(res);
+        }
+    }
+
     return descriptor;
 
 }
@@ -731,12 +1363,11 @@ int fat16_read(struct disk* disk, void* descriptor, uint32_t size, uint32_t nmem
     int res = 0;
 
     struct fat_file_descriptor* fat_desc = descriptor;
-    struct fat_directory_item* item = fat_desc->item->item;
     int offset = fat_desc->pos;
 
     for(uint32_t i=0; i<nmemb; i++)
     {
-        res = fat16_retrieve_data(disk,fat16_get_first_cluster(item),offset,size,out_ptr);
+        res = fat16_retrieve_data(disk,fat_desc,offset,size,out_ptr);
 
         if(ISERR(res))
         {
@@ -748,11 +1379,85 @@ int fat16_read(struct disk* disk, void* descriptor, uint32_t size, uint32_t nmem
 
     }
 
+    fat_desc->pos = offset;
     res = nmemb;
 out:
     return res; 
 }
 
+//-----------------------------------------------------------------------------
+int fat16_write(struct disk* disk, void* descriptor, uint32_t size, uint32_t nmemb, const char* in_ptr)
+{
+    int res = 0;
+
+    struct fat_file_descriptor* fat_desc = descriptor;
+    if(fat_desc->mode == FILE_MODE_READ)
+    {
+        res = -ERDONLY;
+        goto out;
+    }
+
+    struct fat_directory_item* item = fat_desc->item->item;
+
+    for(uint32_t i=0; i<nmemb; i++)
+    {
+        if(fat_desc->mode == FILE_MODE_APPEND)
+        {
+            fat_desc->pos = item->filesize;
+        }
+
+        res = fat16_store_data(disk,fat_desc,fat_desc->pos,size,in_ptr);
+        if(res < 0)
+        {
+            goto out;
+        }
+
+        in_ptr += size;
+        fat_desc->pos += size;
+
+        // the entry itself is written on flush and close, not after every write
+        if(fat_desc->pos > item->filesize)
+        {
+            item->filesize = fat_desc->pos;
+            fat_desc->dirty = true;
+        }
+    }
+
+    res = nmemb;
+out:
+    return res;
+}
+
+//-----------------------------------------------------------------------------
+static int fat16_sync_directory_item(struct fat_file_descriptor* descriptor)
+{
+    int res = 0;
+
+    if(descriptor->dirty)
+    {
+        res = fat16_write_directory_item(descriptor->disk,descriptor->item);
+        if(res == 0)
+        {
+            descriptor->dirty = false;
+        }
+    }
+
+    return res;
+}
+
+//-----------------------------------------------------------------------------
+int fat16_flush(struct disk* disk, void* private)
+{
+    // the data, the table and the entry are in the sector cache, the disk takes them all
+    int res = fat16_sync_directory_item((struct fat_file_descriptor*)private);
+    if(res < 0)
+    {
+        return res;
+    }
+
+    return disk_flush(disk);
+}
+
 //-----------------------------------------------------------------------------
 int fat16_seek(void* private, uint32_t offset, FILE_SEEK_MODE seek_mode)
 {
@@ -768,7 +1473,8 @@ int fat16_seek(void* private, uint32_t offset, FILE_SEEK_MODE seek_mode)
 
     struct fat_directory_item* ritem = item->item;
 
-    if(offset >= ritem->filesize)
+    // the end itself is a valid position, writes continue the file from there
+    if(offset > ritem->filesize)
     {
         res = -EIO;
         goto out;
@@ -833,8 +1539,12 @@ static void fat16_free_file_descriptor(struct fat_file_descriptor* descriptor)
 //-----------------------------------------------------------------------------
 int fat16_close(void* private)
 {   
-    fat16_free_file_descriptor((struct fat_file_descriptor*) private);
-    return 0;
+    // the entry goes to the sector cache, only a flush makes it durable
+    struct fat_file_descriptor* descriptor = private;
+    int res = fat16_sync_directory_item(descriptor);
+
+    fat16_free_file_descriptor(descriptor);
+    return res;
 }
 
 
@@ -11,6 +11,7 @@
 
 struct filesystem* filesystems[CHUCHUOS_MAX_FILESYSTEMS];
 struct file_descriptor* file_descriptors[CHUCHUOS_MAX_FILE_DESCRIPTORS];
+static struct slab_cache* file_descriptor_cache = 0;
 
 //-------------------------------------------------------------
 static struct filesystem**  fs_get_free_filesystem()
@@ -62,6 +63,7 @@ void fs_load()
 void fs_init()
 {
     memset(file_descriptors,0,sizeof(file_descriptors));
+    file_descriptor_cache = kcache_create("file_descriptor",sizeof(struct file_descriptor));
     fs_load();
 }
 
@@ -75,7 +77,11 @@ static int file_new_descriptor(struct file_descriptor** desc_out)
     {
         if(file_descriptors[i]==0)
         {
-            struct file_descriptor* desc = kzalloc(sizeof(struct file_descriptor));
+            struct file_descriptor* desc = kcache_zalloc(file_descriptor_cache);
+            if(!desc)
+            {
+                break;
+            }
 
             // Descriptor index always starts with 1
             desc->index = i+1;
@@ -177,7 +183,7 @@ int fopen(const char* filename, const char* mode_str)
     // checking if the file mode is valid
     if(mode == FILE_MODE_INVALID)
     {
-        return -EINVARG;
+        res = -EINVARG;
         goto out;
     }
 
@@ -208,6 +214,11 @@ int fopen(const char* filename, const char* mode_str)
 
 
 out:
+    // the filesystem only needs the path while opening
+    if(file_header)
+    {
+        pathparser_free(file_header);
+    }
 
     if (res < 0)
     {
@@ -242,6 +253,59 @@ out:
     return res;
 }
 
+//-----------------------------------------------------------------------------
+
+int fwrite(const void* write_buf, uint32_t size, uint32_t nmemb, int fd)
+{
+    // returns once the data is in the sector cache, fflush makes it durable
+    int res = 0;
+
+    if(size == 0 || nmemb == 0 || fd < -1)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    struct file_descriptor* desc = file_get_descriptor(fd);
+    if(!desc)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    if(!desc->filesystem->write)
+    {
+        res = -ERDONLY;
+        goto out;
+    }
+
+    res = desc->filesystem->write(desc->disk,desc->privte,size,nmemb,(const char*)write_buf);
+
+out:
+    return res;
+}
+
+//----------------------------------------------------------------------------------
+int fflush(int fd)
+{
+    // a barrier, what was written to fd before is on the disk once this returns
+    int res = 0;
+    struct file_descriptor* desc = file_get_descriptor(fd);
+    if(!desc)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    if(desc->filesystem->flush)
+    {
+        res = desc->filesystem->flush(desc->disk,desc->privte);
+    }
+
+out:
+    return res;
+}
+
 //----------------------------------------------------------------------------------
 int fseek(int fd, int offset, FILE_SEEK_MODE whence)
 {
@@ -281,7 +345,7 @@ out:
 static void file_free_descriptor(struct file_descriptor* descriptor)
 {
     file_descriptors[descriptor->index-1] = 0x00;
-    kfree(descriptor);
+    kcache_free(file_descriptor_cache,descriptor);
 }
 
 //----------------------------------------------------------------------------------
@@ -295,12 +359,10 @@ int fclose(int fd)
         goto out;
     }
 
+    // the filesystem lets go of its part even when it could not write it back
     res = descriptor->filesystem->close(descriptor->privte);
+    file_free_descriptor(descriptor);
 
-    if(res == CHUCHUOS_ALL_OK)
-    {
-        file_free_descriptor(descriptor);
-    }
 out:
     return res;
 }
\ No newline at end of file
@@ -39,6 +39,11 @@ typedef void* (*FS_OPEN_FUNCTION) (struct disk* disk, struct path_part* path, FI
 
 typedef int (*FS_READ_FUNCTION) (struct disk* disk, void* private, uint32_t size, uint32_t nmemb, char* out);
 
+typedef int (*FS_WRITE_FUNCTION) (struct disk* disk, void* private, uint32_t size, uint32_t nmemb, const char* in);
+
+// makes everything written through the file durable
+typedef int (*FS_FLUSH_FUNCTION) (struct disk* disk, void* private);
+
 typedef int (*FS_RESOLVE_FUNCTION)(struct disk* disk);
 
 typedef int (*FS_SEEK_FUNCTION) (void* private, uint32_t offset, FILE_SEEK_MODE seek_mode);
@@ -61,6 +66,8 @@ struct filesystem
     FS_RESOLVE_FUNCTION resolve;  // we typedefed the function pointer
     FS_OPEN_FUNCTION open;
     FS_READ_FUNCTION read;
+    FS_WRITE_FUNCTION write;
+    FS_FLUSH_FUNCTION flush;
     FS_SEEK_FUNCTION seek;
     FS_STAT_FUNCTION stat;
     FS_CLOSE_FUNCTION close;
@@ -86,6 +93,8 @@ void fs_init();
 void fs_insert_filesystem(struct filesystem* filesystem);
 int fopen(const char* filename, const char* mode_str);
 int fread(void* read_buf, uint32_t size, uint32_t nmemb, int fd);
+int fwrite(const void* write_buf, uint32_t size, uint32_t nmemb, int fd);
+int fflush(int fd);
 int fseek(int fd, int offset, FILE_SEEK_MODE whence);
 int fstat(int fd, struct file_stat* stat);
 int fclose(int fd);
@@ -5,14 +5,24 @@ section .asm
 
 extern int21h_handler
 extern no_interrupt_handler 
+extern page_fault_handler
+extern int2eh_handler
+extern int2fh_handler
+extern no_interrupt_slave_handler
 
 global idt_load
 global enable_interrupts
 global disable_interrupts 
+global wait_for_interrupt
 global no_interrupt
+global no_interrupt_slave
 
 
 global int21h
+global int2eh
+global int2fh
+global isr_page_fault
+global idt_get_fault_address
 
 ;-----------------------------
 enable_interrupts:
@@ -21,9 +31,17 @@ enable_interrupts:
 
 ;-----------------------------
 disable_interrupts:
-    sti
+    cli
     ret 
 
+;-----------------------------
+; called with interrupts disabled, sti only takes effect after the next instruction
+; so an interrupt arriving in between still wakes up the hlt
+wait_for_interrupt:
+    sti
+    hlt
+    ret
+
 ;-----------------------------
 idt_load:
     push ebp
@@ -45,6 +63,26 @@ int21h:
     iret 
 
 
+;-----------------------------
+int2eh:
+    cli
+    pushad
+    call int2eh_handler
+    popad
+    sti
+    iret
+
+
+;-----------------------------
+int2fh:
+    cli
+    pushad
+    call int2fh_handler
+    popad
+    sti
+    iret
+
+
 ;-----------------------------
 no_interrupt:
     cli
@@ -52,4 +90,33 @@ no_interrupt:
     call no_interrupt_handler
     popad
     sti
-    iret 
\ No newline at end of file
+    iret 
+
+
+;-----------------------------
+no_interrupt_slave:
+    cli
+    pushad
+    call no_interrupt_slave_handler
+    popad
+    sti
+    iret
+
+
+;-----------------------------
+; vector 14, the cpu pushes an error code which has to be removed before iret
+isr_page_fault:
+    cli
+    pushad
+    push dword [esp+32] ; error code, it sits right above the 8 registers pushed by pushad
+    call page_fault_handler
+    add esp, 4
+    popad
+    add esp, 4          ; drop the error code
+    iret                ; restores the interrupt flag of the faulting code
+
+
+;-----------------------------
+idt_get_fault_address:
+    mov eax, cr2        ; cr2 holds the address which caused the last page fault
+    ret
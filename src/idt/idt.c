@@ -3,13 +3,23 @@
 #include "kernel.h"
 #include "memory/memory.h"
 #include "io/io.h"
+#include "memory/paging/paging.h"
+#include "disk/ata.h"
 
 struct idtr_desc idtr_descriptor; // this structure holds the address and size of the interrupt table
 struct idt_desc idt_descriptors[CHUCHUOS_TOTAL_INTERRUPTS];  // info of each interrupt
 
+// handlers of pci devices, whose irq is only known at run time
+static IDT_IRQ_HANDLER_FUNCTION idt_irq_handlers[16];
+
 extern void idt_load(struct idtr_desc *ptr);
 extern void int21h();
 extern void no_interrupt();
+extern void no_interrupt_slave();
+extern void int2eh();
+extern void int2fh();
+extern void isr_page_fault();
+extern void* idt_get_fault_address();
 
 
 void int21h_handler()
@@ -22,11 +32,78 @@ void int21h_handler()
 }
 
 
+static void idt_dispatch_irq(unsigned short pic_command, int first_irq)
+{
+    // the irqs share the no_interrupt stubs, the in-service register of the PIC tells which one this is
+    outb(pic_command, 0x0B);
+    unsigned char in_service = insb(pic_command);
+
+    for (int i = 0; i < 8; i++)
+    {
+        if (in_service & (1 << i))
+        {
+            if (idt_irq_handlers[first_irq + i])
+            {
+                idt_irq_handlers[first_irq + i]();
+            }
+            return;
+        }
+    }
+}
+
 void no_interrupt_handler()
 {
+    idt_dispatch_irq(0x20, 0);
+    outb(0x20, 0x20);
+}
+
+void no_interrupt_slave_handler()
+{
+    idt_dispatch_irq(0xA0, 8);
+
+    // irqs 8-15 need the acknowledgement on the slave PIC as well
+    outb(0xA0, 0x20);
     outb(0x20, 0x20);
 }
 
+void idt_register_irq_handler(int irq, IDT_IRQ_HANDLER_FUNCTION handler)
+{
+    if (irq < 0 || irq >= 16)
+    {
+        return;
+    }
+
+    idt_irq_handlers[irq] = handler;
+}
+
+void int2eh_handler()
+{
+    // irq 14, the primary ata channel
+    ata_handle_interrupt(0);
+    outb(0xA0, 0x20);
+    outb(0x20, 0x20);
+}
+
+void int2fh_handler()
+{
+    // irq 15, the secondary ata channel
+    ata_handle_interrupt(1);
+    outb(0xA0, 0x20);
+    outb(0x20, 0x20);
+}
+
+void page_fault_handler(uint32_t error_code)
+{
+    // missing pages of lazily mapped regions get mapped here, the instruction is then retried
+    if(paging_handle_fault(idt_get_fault_address(),error_code) == 0)
+    {
+        return;
+    }
+
+    print("Page fault\n");
+    while(1) {}
+}
+
 void idt_zero()
 {
     print("Divide by zero error\n");
@@ -62,9 +139,17 @@ void idt_init()
         idt_set(i,no_interrupt);
     }
 
+    for(int i=0x28; i<0x30; i++)
+    {
+        idt_set(i,no_interrupt_slave);
+    }
+
     idt_set(0, idt_zero);
+    idt_set(14, isr_page_fault);
     idt_set(0x21, int21h);        //remember we have remapped PIC to start from 0x20,
                                         // so 0x21 is keyboard interrupt.
+    idt_set(0x2E, int2eh);        // the slave PIC starts at 0x28, irq 14 is the primary ata channel
+    idt_set(0x2F, int2fh);        // and irq 15 the secondary one
 
     idt_load(&idtr_descriptor);
 
@@ -19,11 +19,16 @@ struct idtr_desc
     uint32_t base;
 } __attribute__((packed));
 
+// runs for an irq without a stub of its own, the end of interrupt is sent afterwards
+typedef void (*IDT_IRQ_HANDLER_FUNCTION)();
+
 void idt_init();
 void idt_set(int interrupt_no, void* address);
+void idt_register_irq_handler(int irq, IDT_IRQ_HANDLER_FUNCTION handler);
 
 void enable_interrupts();
 void disable_interrupts();
+void wait_for_interrupt();
 
 
 
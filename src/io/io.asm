@@ -1,50 +1,34 @@
 section .asm
 
-global insb
-global insw
-global outb
-global outw
+global insw_rep
+global outsw_rep
 
-insb:
+insw_rep:
     push ebp
     mov ebp, esp
+    push edi
 
-    xor eax, eax
-    mov edx, [ebp+8]
-    in al, dx
+    mov edx, [ebp+8]    ; port
+    mov edi, [ebp+12]   ; destination buffer
+    mov ecx, [ebp+16]   ; number of words
+    cld
+    rep insw
 
+    pop edi
     pop ebp
     ret
 
-insw:
+outsw_rep:
     push ebp
     mov ebp, esp
+    push esi
 
-    xor eax, eax
-    mov edx, [ebp+8]
-    in ax, dx
+    mov edx, [ebp+8]    ; port
+    mov esi, [ebp+12]   ; source buffer
+    mov ecx, [ebp+16]   ; number of words
+    cld
+    rep outsw
 
+    pop esi
     pop ebp
     ret
-
-outb:
-    push ebp
-    mov ebp, esp
-
-    mov eax, [ebp+12]
-    mov edx, [ebp+8]
-    out dx, al
-
-    pop ebp
-    ret
-
-outw:
-    push ebp
-    mov ebp, esp
-
-    mov eax, [ebp+12]
-    mov edx, [ebp+8]
-    out dx, ax
-
-    pop ebp
-    ret
\ No newline at end of file
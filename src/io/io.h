@@ -1,11 +1,47 @@
 #ifndef IO_H
 #define IO_H
 
-unsigned char insb(unsigned short port);    // read a byte from port
-unsigned short insw(unsigned short port);    // read a word from port
+// Single port accesses are inlined, a call per port access costs more than the access itself
 
-void outb(unsigned short port, unsigned char val); // output a byte to port
-void outw(unsigned short port, unsigned short val); // output a word to port
+static inline __attribute__((always_inline)) unsigned char insb(unsigned short port)    // read a byte from port
+{
+    unsigned char val;
+    asm volatile("inb %1, %0" : "=a"(val) : "Nd"(port));
+    return val;
+}
+
+static inline __attribute__((always_inline)) unsigned short insw(unsigned short port)   // read a word from port
+{
+    unsigned short val;
+    asm volatile("inw %1, %0" : "=a"(val) : "Nd"(port));
+    return val;
+}
+
+static inline __attribute__((always_inline)) unsigned int insl(unsigned short port)     // read a double word from port
+{
+    unsigned int val;
+    asm volatile("inl %1, %0" : "=a"(val) : "Nd"(port));
+    return val;
+}
+
+static inline __attribute__((always_inline)) void outb(unsigned short port, unsigned char val) // output a byte to port
+{
+    asm volatile("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline __attribute__((always_inline)) void outw(unsigned short port, unsigned short val) // output a word to port
+{
+    asm volatile("outw %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline __attribute__((always_inline)) void outl(unsigned short port, unsigned int val)  // output a double word to port
+{
+    asm volatile("outl %0, %1" : : "a"(val), "Nd"(port));
+}
+
+// bulk transfers with rep insw/outsw, count is in words
+void insw_rep(unsigned short port, void* buf, unsigned int count);
+void outsw_rep(unsigned short port, const void* buf, unsigned int count);
 
 
 
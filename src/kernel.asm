@@ -6,6 +6,7 @@ extern  kernel_main
 
 CODE_SEG equ 0x08
 DATA_SEG equ 0x10
+E820_MAP equ 0x0500     ; must match CHUCHUOS_E820_MAP_ADDRESS in config.h
 
 _start:
     ; in boot.asm we have already initially CS register by jmp instruction. The rest of the segment registers
@@ -32,10 +33,29 @@ _start:
     mov al, 0x20    ; interrupt 0x20 (decimal: 32) is where master ISR should start
     out 0x21, al
 
+    mov al, 00000100b   ; the slave PIC hangs off irq 2
+    out 0x21, al
+
     mov al, 00000001b
     out 0x21, al 
     ; End remap of master PIC
- 
+
+    ; Remap the slave PIC, irq 8-15 (the ata channels sit on 14 and 15)
+    mov al, 00010001b
+    out 0xA0, al    ; 0xA0 is the command port of the slave PIC
+
+    mov al, 0x28    ; slave ISRs start right after the master ones
+    out 0xA1, al
+
+    mov al, 00000010b   ; cascade identity, connected to irq 2 of the master
+    out 0xA1, al
+
+    mov al, 00000001b
+    out 0xA1, al
+    ; End remap of slave PIC
+
+    ; boot.asm left the BIOS memory map here, kernel_main gets its address as argument
+    push dword E820_MAP
     call kernel_main
 
     jmp $
@@ -1,15 +1,24 @@
 #include "kernel.h"
+#include "config.h"
 #include <stdint.h>
 #include <stddef.h>
 #include "idt/idt.h"
 #include "memory/heap/kheap.h"
 #include "io/io.h"
 #include "memory/paging/paging.h"
+#include "memory/paging/paging_bench.h"
 #include "disk/disk.h"
 #include "string/string.h"
 #include "fs/pparser.h"
 #include "disk/streamer.h"
 #include "fs/file.h"
+#include "memory/frame/frame.h"
+#include "disk/ata.h"
+#include "disk/ata_bench.h"
+#include "disk/virtio_blk.h"
+#include "disk/virtio_blk_bench.h"
+#include "disk/ramdisk.h"
+#include "time/timer.h"
 
 uint16_t *video_mem = 0;
 uint16_t terminal_row = 0;
@@ -75,13 +84,32 @@ void print(const char *str)
 static struct paging_4gb_chunk *kernel_chunk = 0;
 
 //-----------------------------------------------------
-void kernel_main()
+void kernel_panic(const char *message)
+{
+    // nothing sensible can run anymore, stop here with the reason on the screen
+    print(message);
+    disable_interrupts();
+
+    while (1)
+    {
+        __asm__ __volatile__("hlt");
+    }
+}
+
+//-----------------------------------------------------
+void kernel_main(struct e820_memory_map* memory_map)
 {
     terminal_initialize();
     print("Hello World!\n");
 
-    // initialize the heap
-    kheap_init();
+    // manage the physical ram the bios reported
+    frame_init(memory_map);
+
+    // initialize the heap, everything after this allocates from it
+    if (kheap_init() < 0)
+    {
+        kernel_panic("Kernel heap could not be set up, halting\n");
+    }
 
     // initialize the file-system
     fs_init();
@@ -92,6 +120,9 @@ void kernel_main()
     // initializing the interrupt descriptor table
     idt_init();
 
+    // ticks from irq 0 age the dirty sectors of the cache
+    timer_init();
+
     // Setup paging
     kernel_chunk = paging_create_new_4gb_chunk(PAGING_IS_WRITEABLE | PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL);
 
@@ -101,9 +132,33 @@ void kernel_main()
     // enable paging
     enable_paging();
 
+#if CHUCHUOS_PAGING_BENCHMARK
+    paging_benchmark(kernel_chunk);
+#endif
+
     // after initializing the IDT, now enabling interrupts
     enable_interrupts();
 
+    // the disks can signal completion by interrupt from now on
+    ata_enable_irq();
+    virtio_blk_enable_irq();
+
+#if CHUCHUOS_INITRD
+    // read once from the boot disk, from then on its files are served from memory
+    if (ramdisk_load(CHUCHUOS_INITRD_PATH) < 0)
+    {
+        print("No initrd loaded\n");
+    }
+#endif
+
+#if CHUCHUOS_ATA_BENCHMARK
+    ata_benchmark(disk_get(0));
+#endif
+
+#if CHUCHUOS_VIRTIO_BENCHMARK
+    virtio_blk_benchmark();
+#endif
+
     int fd = fopen("0:/hello.txt", "r");
     if (fd)
     {
@@ -119,6 +174,10 @@ void kernel_main()
         print("Testing completed");
     }
 
+#if CHUCHUOS_DISK_IOSTAT_DUMP
+    disk_iostat_print_all();
+#endif
+
     while (1)
     {
     }
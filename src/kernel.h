@@ -1,17 +1,22 @@
 #ifndef KERNEL_H
 #define KERNEL_H
 
+#include <stdint.h>
+
 #define VGA_WIDTH   80
 #define VGA_HEIGHT  20
 
 #define CHUCHUOS_MAX_PATH_LENGTH   108
 #define CHUCHUOS_MAX_PATH   108
 
-void kernel_main();
+struct e820_memory_map;
+
+void kernel_main(struct e820_memory_map* memory_map);
 void print(const char* str);
+void kernel_panic(const char* message);
 
-#define ERROR(value) (void*)(value)    
-#define ERROR_I(value) (int)(value)
-#define ISERR(value) ( (int)value < 0)  // return 1 if val < 0, i.e. it is an error !!
+#define ERROR(value) (void*)(intptr_t)(value)    
+#define ERROR_I(value) (int)(intptr_t)(value)
+#define ISERR(value) ( (intptr_t)(value) < 0)  // return 1 if val < 0, i.e. it is an error !!
 
 #endif
\ No newline at end of file
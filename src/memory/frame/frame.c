@@ -0,0 +1,287 @@
+#include "frame.h"
+#include "config.h"
+#include "status.h"
+#include "memory/memory.h"
+#include <stdbool.h>
+
+#define FRAME_MAX_FRAMES    (0x100000000ull / CHUCHUOS_FRAME_SIZE)
+
+// bit set means the frame is taken or is not usable ram
+static uint32_t* frame_bitmap = 0;
+static uint32_t frame_total_frames = 0;     // frames covered by the bitmap
+static uint32_t frame_usable_frames = 0;
+static uint32_t frame_free_frames = 0;
+static uint32_t frame_alloc_end = 0;        // frames are handed out below this index, top down
+static uint32_t frame_top_free = 0;         // no free frame at or above this index
+static struct e820_memory_map* frame_memory_map = 0;
+
+// used when the bios did not give us a memory map
+static struct e820_entry frame_fallback_entry =
+{
+    .base = 0x00100000,
+    .length = CHUCHUOS_HEAP_ADDRESS + CHUCHUOS_HEAP_SIZE_BYTES - 0x00100000,
+    .type = E820_TYPE_USABLE
+};
+
+//--------------------------------------------------------------------------------
+static bool frame_is_used(uint32_t frame)
+{
+    return frame_bitmap[frame / 32] & (1 << (frame % 32));
+}
+
+//--------------------------------------------------------------------------------
+static void frame_set_used(uint32_t frame)
+{
+    frame_bitmap[frame / 32] |= (1 << (frame % 32));
+}
+
+//--------------------------------------------------------------------------------
+static void frame_set_free(uint32_t frame)
+{
+    frame_bitmap[frame / 32] &= ~(1 << (frame % 32));
+}
+
+//--------------------------------------------------------------------------------
+static uint32_t frame_map_total(struct e820_memory_map* map)
+{
+    return map->total > CHUCHUOS_E820_MAX_ENTRIES ? CHUCHUOS_E820_MAX_ENTRIES : map->total;
+}
+
+//--------------------------------------------------------------------------------
+static struct e820_entry* frame_map_entry(int index)
+{
+    if(!frame_memory_map || frame_memory_map->total == 0)
+    {
+        return index == 0 ? &frame_fallback_entry : 0;
+    }
+
+    return index < frame_map_total(frame_memory_map) ? &frame_memory_map->entries[index] : 0;
+}
+
+//--------------------------------------------------------------------------------
+static void frame_release_range(uint64_t base, uint64_t length)
+{
+    // only whole frames below 4 gb inside the range are usable
+    uint64_t start = (base + CHUCHUOS_FRAME_SIZE - 1) / CHUCHUOS_FRAME_SIZE;
+    uint64_t end = (base + length) / CHUCHUOS_FRAME_SIZE;
+
+    if(end > frame_total_frames)
+    {
+        end = frame_total_frames;
+    }
+
+    for(uint64_t frame=start; frame<end; frame++)
+    {
+        if(frame_is_used(frame))
+        {
+            frame_set_free(frame);
+            frame_usable_frames++;
+            frame_free_frames++;
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------
+void frame_init(struct e820_memory_map* map)
+{
+    struct e820_entry* entry = 0;
+    uint64_t highest_address = 0;
+
+    frame_memory_map = map;
+
+    for(int i=0; (entry = frame_map_entry(i)) != 0; i++)
+    {
+        if(entry->type == E820_TYPE_USABLE && entry->base + entry->length > highest_address)
+        {
+            highest_address = entry->base + entry->length;
+        }
+    }
+
+    if(highest_address > FRAME_MAX_FRAMES * CHUCHUOS_FRAME_SIZE)
+    {
+        highest_address = FRAME_MAX_FRAMES * CHUCHUOS_FRAME_SIZE;
+    }
+
+    // everything starts out taken, then the usable ram regions are released
+    frame_total_frames = highest_address / CHUCHUOS_FRAME_SIZE;
+    frame_bitmap = (uint32_t*)(uintptr_t)CHUCHUOS_FRAME_BITMAP_ADDRESS;
+    memset(frame_bitmap,0xff,(frame_total_frames + 31) / 32 * sizeof(uint32_t));
+
+    for(int i=0; (entry = frame_map_entry(i)) != 0; i++)
+    {
+        if(entry->type == E820_TYPE_USABLE)
+        {
+            frame_release_range(entry->base,entry->length);
+        }
+    }
+
+    // bios data, the bitmap itself, the kernel image and the kernel stack
+    for(uint32_t frame=0; frame < CHUCHUOS_KERNEL_RESERVED_END / CHUCHUOS_FRAME_SIZE && frame < frame_total_frames; frame++)
+    {
+        if(!frame_is_used(frame))
+        {
+            frame_set_used(frame);
+            frame_usable_frames--;
+            frame_free_frames--;
+        }
+    }
+
+    // frames go out from the top of the ram the heap lives in, the heap grows up from its start
+    // towards them, so both can use that memory until it is really all taken. Frames above a hole
+    // in it are not used, the kernel does not map them
+    frame_alloc_end = (uintptr_t)frame_get_usable_end((void*)CHUCHUOS_HEAP_ADDRESS) / CHUCHUOS_FRAME_SIZE;
+    if(frame_alloc_end < CHUCHUOS_HEAP_ADDRESS / CHUCHUOS_FRAME_SIZE)
+    {
+        frame_alloc_end = CHUCHUOS_HEAP_ADDRESS / CHUCHUOS_FRAME_SIZE;
+    }
+    if(frame_alloc_end > frame_total_frames)
+    {
+        frame_alloc_end = frame_total_frames;
+    }
+
+    frame_top_free = frame_alloc_end;
+}
+
+//--------------------------------------------------------------------------------
+void* frame_alloc_contiguous(uint32_t total)
+{
+    uint32_t run = 0;
+
+    if(total == 0)
+    {
+        return 0;
+    }
+
+    for(uint32_t frame=frame_top_free; frame>0; frame--)
+    {
+        uint32_t index = frame - 1;
+
+        if(frame_is_used(index))
+        {
+            run = 0;
+            continue;
+        }
+
+        if(run == 0 && total == 1)
+        {
+            frame_top_free = index + 1;
+        }
+
+        run++;
+        if(run == total)
+        {
+            uint32_t first = index;
+            for(uint32_t i=first; i<first+total; i++)
+            {
+                frame_set_used(i);
+            }
+            frame_free_frames -= total;
+
+            return (void*)(uintptr_t)(first * CHUCHUOS_FRAME_SIZE);
+        }
+    }
+
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+void* frame_alloc()
+{
+    return frame_alloc_contiguous(1);
+}
+
+//--------------------------------------------------------------------------------
+void frame_free(void* frame)
+{
+    uint32_t index = (uintptr_t)frame / CHUCHUOS_FRAME_SIZE;
+
+    if(index >= frame_total_frames || !frame_is_used(index))
+    {
+        return;
+    }
+
+    frame_set_free(index);
+    frame_free_frames++;
+
+    if(index >= frame_top_free && index < frame_alloc_end)
+    {
+        frame_top_free = index + 1;
+    }
+}
+
+//--------------------------------------------------------------------------------
+int frame_claim(void* address, uint32_t total)
+{
+    // takes the given frames, e.g. for the heap which has to stay contiguous
+    uint32_t first = (uintptr_t)address / CHUCHUOS_FRAME_SIZE;
+
+    if(first + total > frame_total_frames)
+    {
+        return -ENOMEM;
+    }
+
+    for(uint32_t i=first; i<first+total; i++)
+    {
+        if(frame_is_used(i))
+        {
+            return -ENOMEM;
+        }
+    }
+
+    for(uint32_t i=first; i<first+total; i++)
+    {
+        frame_set_used(i);
+    }
+    frame_free_frames -= total;
+
+    return 0;
+}
+
+//--------------------------------------------------------------------------------
+void* frame_get_usable_end(void* address)
+{
+    // end of the usable ram around address, following usable regions which touch each other
+    uint64_t end = (uintptr_t)address;
+    bool extended = true;
+    struct e820_entry* entry = 0;
+
+    while(extended)
+    {
+        extended = false;
+
+        for(int i=0; (entry = frame_map_entry(i)) != 0; i++)
+        {
+            if(entry->type == E820_TYPE_USABLE && entry->base <= end && entry->base + entry->length > end)
+            {
+                end = entry->base + entry->length;
+                extended = true;
+            }
+        }
+    }
+
+    if(end > (uint64_t)frame_total_frames * CHUCHUOS_FRAME_SIZE)
+    {
+        end = (uint64_t)frame_total_frames * CHUCHUOS_FRAME_SIZE;
+    }
+
+    return (void*)(uintptr_t)(end & ~(uint64_t)(CHUCHUOS_FRAME_SIZE - 1));
+}
+
+//--------------------------------------------------------------------------------
+void* frame_get_alloc_end()
+{
+    // frame_alloc never returns a frame at or above this address
+    return (void*)(uintptr_t)(frame_alloc_end * CHUCHUOS_FRAME_SIZE);
+}
+
+//--------------------------------------------------------------------------------
+uint32_t frame_total_usable()
+{
+    return frame_usable_frames;
+}
+
+//--------------------------------------------------------------------------------
+uint32_t frame_total_free()
+{
+    return frame_free_frames;
+}
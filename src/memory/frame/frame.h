@@ -0,0 +1,35 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define E820_TYPE_USABLE    1
+
+// one entry of the bios memory map, filled by int 0x15 eax=0xE820 in boot.asm
+struct e820_entry
+{
+    uint64_t base;
+    uint64_t length;
+    uint32_t type;
+    uint32_t acpi_attributes;
+} __attribute__((packed));
+
+struct e820_memory_map
+{
+    uint32_t total;
+    struct e820_entry entries[];
+} __attribute__((packed));
+
+
+void frame_init(struct e820_memory_map* map);
+void* frame_alloc();
+void* frame_alloc_contiguous(uint32_t total);
+void frame_free(void* frame);
+int frame_claim(void* address, uint32_t total);
+void* frame_get_usable_end(void* address);
+void* frame_get_alloc_end();
+uint32_t frame_total_usable();
+uint32_t frame_total_free();
+
+#endif
@@ -28,10 +28,12 @@ static int heap_validate_table(void* ptr, void* end, struct heap_table* table)
 //--------------------------------------------------------------------------------
 static bool heap_validate_alignment(void* ptr) // validate giving address adhers to 4096 byte alignment aka block
 {
-    return (((unsigned int)ptr % CHUCHUOS_HEAP_BLOCK_SIZE) == 0) ; // return-1 if condition is true
+    return (((uintptr_t)ptr % CHUCHUOS_HEAP_BLOCK_SIZE) == 0) ; // return-1 if condition is true
                             // true means it is aligned correctly i.e. address size is divisible by 4096
 }
 
+static void heap_add_blocks(struct heap* heap, int start_block, int end_block);
+
 //--------------------------------------------------------------------------------
 int heap_create(struct heap* heap, void* ptr, void* end, struct heap_table* table)
 {
@@ -67,93 +69,209 @@ int heap_create(struct heap* heap, void* ptr, void* end, struct heap_table* tabl
     size_t table_size = sizeof(HEAP_BLOCK_TABLE_ENTRY)*table->total;
     memset(table->entries,HEAP_BLOCK_TABLE_ENTRY_FREE,table_size);
 
+    /* In the 3rd part, the whole pool is handed to the buddy free lists */
+
+    heap_add_blocks(heap,0,table->total);
+
 out:
     return res;
 }
 
 
 //------------------------------------------------------------------------------------------
-void heap_mark_block_taken(struct heap* heap, int start_block, int total_blocks)
+void* heap_block_to_address(struct heap* heap, int block)
 {
-    int end_block = (start_block + total_blocks)-1;
+    return heap->saddr + (block*CHUCHUOS_HEAP_BLOCK_SIZE);
+}
 
-    HEAP_BLOCK_TABLE_ENTRY entry = HEAP_BLOCK_TABLE_ENTRY_TAKEN | HEAP_BLOCK_IS_FIRST;
+//-------------------------------------------------------------------------------
+int heap_address_to_block(struct heap* heap, void* address)
+{
+    return ((int)(address-heap->saddr))/(CHUCHUOS_HEAP_BLOCK_SIZE);
+}
 
-    if(total_blocks > 1)
-    {
-        entry |= HEAP_BLOCK_HAS_NEXT;
-    }
+//------------------------------------------------------------------------------------------
+static int heap_get_entry_type(HEAP_BLOCK_TABLE_ENTRY entry)
+{
+    return entry & HEAP_BLOCK_TABLE_ENTRY_TAKEN;
+}
 
-    for(int i=start_block; i<= end_block; i++)
-    {
-        heap->table->entries[i] = entry;
-        entry = HEAP_BLOCK_TABLE_ENTRY_TAKEN;
+//------------------------------------------------------------------------------------------
+static uint32_t heap_get_entry_order(HEAP_BLOCK_TABLE_ENTRY entry)
+{
+    return (entry & HEAP_BLOCK_ORDER_MASK) >> HEAP_BLOCK_ORDER_SHIFT;
+}
 
-        if(i != end_block-1)
-        {
-            entry |= HEAP_BLOCK_HAS_NEXT;
-        }
-    }
+//------------------------------------------------------------------------------------------
+static HEAP_BLOCK_TABLE_ENTRY heap_make_entry(int type, uint32_t order)
+{
+    return type | HEAP_BLOCK_IS_FIRST | (order << HEAP_BLOCK_ORDER_SHIFT);
+}
 
+//------------------------------------------------------------------------------------------
+static void heap_free_list_push(struct heap* heap, int block, uint32_t order)
+{
+    // the list node lives inside the free block itself, so the free lists cost no extra memory
+    struct heap_free_block* free_block = heap_block_to_address(heap,block);
+    free_block->prev = 0;
+    free_block->next = heap->free_lists[order];
 
-}
+    if(free_block->next)
+    {
+        free_block->next->prev = free_block;
+    }
 
+    heap->free_lists[order] = free_block;
+    heap->free_orders |= (1 << order);
+    heap->table->entries[block] = heap_make_entry(HEAP_BLOCK_TABLE_ENTRY_FREE,order);
+}
 
 //------------------------------------------------------------------------------------------
-void* heap_block_to_address(struct heap* heap, int block)
+static void heap_free_list_remove(struct heap* heap, int block, uint32_t order)
 {
-    return heap->saddr + (block*CHUCHUOS_HEAP_BLOCK_SIZE);
-}
+    struct heap_free_block* free_block = heap_block_to_address(heap,block);
+
+    if(free_block->prev)
+    {
+        free_block->prev->next = free_block->next;
+    }
+    else
+    {
+        heap->free_lists[order] = free_block->next;
+    }
+
+    if(free_block->next)
+    {
+        free_block->next->prev = free_block->prev;
+    }
 
+    if(!heap->free_lists[order])
+    {
+        heap->free_orders &= ~(1 << order);
+    }
+}
 
 //------------------------------------------------------------------------------------------
-static int heap_get_entry_type(HEAP_BLOCK_TABLE_ENTRY entry)
+static bool heap_is_free_buddy(struct heap* heap, int block, uint32_t order)
 {
-    return entry & 0x0f;
+    // a buddy can only be merged if it is the first block of a free buddy block of the same order
+    if(block < 0 || block >= (int)heap->table->total)
+    {
+        return false;
+    }
+
+    return heap->table->entries[block] == heap_make_entry(HEAP_BLOCK_TABLE_ENTRY_FREE,order);
 }
 
 //------------------------------------------------------------------------------------------
-int heap_get_start_block(struct heap* heap, uint32_t total_blocks)
+static void heap_free_blocks(struct heap* heap, int block, uint32_t order)
 {
-    struct heap_table* table = heap->table;
-    int block_counter = 0;
-    int block_start = -1;
-    int check_entry;
-
-    for(size_t i=0; i<table->total; i++)
+    // merge with the buddy as long as it is free, at most HEAP_BUDDY_MAX_ORDER steps
+    while(order < HEAP_BUDDY_MAX_ORDER)
     {
-        check_entry = heap_get_entry_type(table->entries[i]);
+        int buddy = block ^ (1 << order);
 
-        if(check_entry != HEAP_BLOCK_TABLE_ENTRY_FREE)
+        if(!heap_is_free_buddy(heap,buddy,order))
         {
-            block_counter = 0;
-            block_start = -1 ;
-            continue;   // go back to the start of loop
+            break;
         }
 
-        // if we are here, we found a free entry
-        if (block_start == -1)
+        heap_free_list_remove(heap,buddy,order);
+
+        if(buddy < block)
         {
-            block_start = i;
+            heap->table->entries[block] = HEAP_BLOCK_TABLE_ENTRY_FREE;  // no longer the first block
+            block = buddy;
+        }
+        else
+        {
+            heap->table->entries[buddy] = HEAP_BLOCK_TABLE_ENTRY_FREE;
         }
-        block_counter++;
 
-        if(block_counter == total_blocks)
+        order++;
+    }
+
+    heap_free_list_push(heap,block,order);
+}
+
+//------------------------------------------------------------------------------------------
+static void heap_add_blocks(struct heap* heap, int start_block, int end_block)
+{
+    // split [start_block,end_block) into the largest naturally aligned power of two pieces
+    int block = start_block;
+
+    while(block < end_block)
+    {
+        uint32_t order = 0;
+
+        while(order < HEAP_BUDDY_MAX_ORDER &&
+              (block % (1 << (order+1))) == 0 &&
+              block + (1 << (order+1)) <= end_block)
         {
-            break;
+            order++;
         }
 
+        heap_free_blocks(heap,block,order);
+        block += (1 << order);
     }
+}
 
-    if(block_start == -1)
+//------------------------------------------------------------------------------------------
+static uint32_t heap_blocks_to_order(uint32_t total_blocks)
+{
+    uint32_t order = 0;
+
+    while((1u << order) < total_blocks)
+    {
+        order++;
+    }
+
+    return order;
+}
+
+//------------------------------------------------------------------------------------------
+int heap_get_start_block(struct heap* heap, uint32_t total_blocks)
+{
+    uint32_t order = heap_blocks_to_order(total_blocks);
+    uint32_t found_order = order;
+
+    if(order > HEAP_BUDDY_MAX_ORDER)
     {
         return -ENOMEM;
     }
 
+    // smallest order which has a free block and is big enough for the request
+    while(found_order <= HEAP_BUDDY_MAX_ORDER && !(heap->free_orders & (1 << found_order)))
+    {
+        found_order++;
+    }
+
+    if(found_order > HEAP_BUDDY_MAX_ORDER)
+    {
+        return -ENOMEM;
+    }
+
+    int block_start = heap_address_to_block(heap,heap->free_lists[found_order]);
+    heap_free_list_remove(heap,block_start,found_order);
+
+    // split the block in halves, giving the upper halves back to the free lists
+    while(found_order > order)
+    {
+        found_order--;
+        heap_free_list_push(heap,block_start + (1 << found_order),found_order);
+    }
+
     return block_start;
 
 }
 
+//------------------------------------------------------------------------------------------
+void heap_mark_block_taken(struct heap* heap, int start_block, int total_blocks)
+{
+    // only the first entry is marked, the order tells how many blocks belong to it
+    heap->table->entries[start_block] = heap_make_entry(HEAP_BLOCK_TABLE_ENTRY_TAKEN,heap_blocks_to_order(total_blocks));
+}
+
 //------------------------------------------------------------------------------------------
 void* heap_malloc_blocks(struct heap* heap, uint32_t total_blocks)
 {
@@ -161,6 +279,12 @@ void* heap_malloc_blocks(struct heap* heap, uint32_t total_blocks)
 
     int start_block = heap_get_start_block(heap,total_blocks); // need function which tells the start block which hasn enough consecutive blocks available
 
+    // keep growing the heap until a big enough buddy block shows up or it can not grow anymore
+    while(start_block < 0 && heap->grow && heap->grow(heap,total_blocks*CHUCHUOS_HEAP_BLOCK_SIZE) == 0)
+    {
+        start_block = heap_get_start_block(heap,total_blocks);
+    }
+
     if(start_block < 0)
     {
         goto out;  // could not find any block which fits our requirement
@@ -171,6 +295,10 @@ void* heap_malloc_blocks(struct heap* heap, uint32_t total_blocks)
     // at the end we need to mark the block as taken
     heap_mark_block_taken(heap,start_block,total_blocks);
 
+    uint32_t order = heap_blocks_to_order(total_blocks);
+    heap->live_allocations[order]++;
+    heap->total_allocations[order]++;
+
 out:
     return address;
 }
@@ -197,36 +325,67 @@ void* heap_malloc(struct heap* heap, size_t size)
     size_t aligned_size = heap_align_value_to_upper_block(size);
     uint32_t total_blocks = aligned_size / CHUCHUOS_HEAP_BLOCK_SIZE;
 
+    if(total_blocks == 0)
+    {
+        return 0;
+    }
+
     return(heap_malloc_blocks(heap,total_blocks));  // this function returns the address of the starting block
                                                     // which has enough blocks
-
-    return 0;
 }
 
 //-------------------------------------------------------------------------------
 void heap_mark_blocks_free(struct heap* heap, int start_block)
 {
-    struct heap_table* table = heap->table;
+    HEAP_BLOCK_TABLE_ENTRY entry = heap->table->entries[start_block];
 
-    for(int i= start_block; i< (int)table->total; i++)
+    // ignore pointers which are not the start of an allocation, e.g. double frees
+    if(heap_get_entry_type(entry) != HEAP_BLOCK_TABLE_ENTRY_TAKEN || !(entry & HEAP_BLOCK_IS_FIRST))
     {
-        HEAP_BLOCK_TABLE_ENTRY entry = table->entries[i];
-        table->entries[i]= HEAP_BLOCK_TABLE_ENTRY_FREE;
-
-        if( !(entry & HEAP_BLOCK_HAS_NEXT))
-        {
-            break;
-        }
+        return;
     }
+
+    heap->live_allocations[heap_get_entry_order(entry)]--;
+    heap_free_blocks(heap,start_block,heap_get_entry_order(entry));
 }
 
 
-//-------------------------------------------------------------------------------
-int heap_address_to_block(struct heap* heap, void* address)
+//--------------------------------------------------------------------------------
+void* heap_get_allocation_start(struct heap* heap, void* ptr)
 {
-    return ((int)(address-heap->saddr))/(CHUCHUOS_HEAP_BLOCK_SIZE);
-}
+    // walk outwards through the naturally aligned candidates, the first block marked
+    // as first is the start of the buddy block which contains ptr
+    if(ptr < heap->saddr)
+    {
+        return 0;
+    }
+
+    int block = heap_address_to_block(heap,ptr);
+    if(block >= (int)heap->table->total)
+    {
+        return 0;
+    }
 
+    for(uint32_t order=0; order<=HEAP_BUDDY_MAX_ORDER; order++)
+    {
+        int candidate = block & ~((1 << order)-1);
+        HEAP_BLOCK_TABLE_ENTRY entry = heap->table->entries[candidate];
+
+        if(!(entry & HEAP_BLOCK_IS_FIRST))
+        {
+            continue;
+        }
+
+        if(heap_get_entry_type(entry) != HEAP_BLOCK_TABLE_ENTRY_TAKEN || heap_get_entry_order(entry) < order)
+        {
+            return 0;   // ptr lies in a free block
+        }
+
+        return heap_block_to_address(heap,candidate);
+    }
+
+    return 0;
+}
 
 //--------------------------------------------------------------------------------
 void heap_free(struct heap* heap, void* ptr)
@@ -235,6 +394,77 @@ void heap_free(struct heap* heap, void* ptr)
     // we can mark the block as free  : heap_address_to_block
     int start_block = heap_address_to_block(heap,ptr);
 
+    if(ptr < heap->saddr || start_block >= (int)heap->table->total)
+    {
+        return;
+    }
+
     return( heap_mark_blocks_free(heap,start_block));
 
 }
+
+//--------------------------------------------------------------------------------
+void heap_get_stats(struct heap* heap, struct heap_stats* stats)
+{
+    struct heap_table* table = heap->table;
+    uint32_t free_run = 0;
+
+    memset(stats,0,sizeof(struct heap_stats));
+    stats->total_blocks = table->total;
+
+    // hop from one buddy block to the next, the first entry of each tells its size
+    for(size_t i=0; i<table->total; )
+    {
+        HEAP_BLOCK_TABLE_ENTRY entry = table->entries[i];
+        uint32_t order = heap_get_entry_order(entry);
+        uint32_t blocks = 1 << order;
+
+        if(heap_get_entry_type(entry) == HEAP_BLOCK_TABLE_ENTRY_TAKEN)
+        {
+            stats->used_blocks += blocks;
+            free_run = 0;
+        }
+        else
+        {
+            stats->free_blocks += blocks;
+            stats->free_blocks_per_order[order]++;
+            free_run += blocks;
+
+            if(free_run > stats->largest_free_run)
+            {
+                stats->largest_free_run = free_run;
+            }
+        }
+
+        i += blocks;
+    }
+
+    if(stats->free_blocks)
+    {
+        stats->fragmentation = 100 - ((stats->largest_free_run * 100) / stats->free_blocks);
+    }
+
+    memcpy(stats->live_allocations,heap->live_allocations,sizeof(stats->live_allocations));
+    memcpy(stats->total_allocations,heap->total_allocations,sizeof(stats->total_allocations));
+}
+
+//--------------------------------------------------------------------------------
+int heap_grow(struct heap* heap, void* new_end)
+{
+    // appends the blocks between the current end of the heap and new_end
+    struct heap_table* table = heap->table;
+    int old_total = table->total;
+
+    if(!heap_validate_alignment(new_end) || new_end <= heap_block_to_address(heap,old_total))
+    {
+        return -EINVARG;
+    }
+
+    int new_total = heap_address_to_block(heap,new_end);
+    memset(&table->entries[old_total],HEAP_BLOCK_TABLE_ENTRY_FREE,new_total-old_total);
+    table->total = new_total;
+
+    heap_add_blocks(heap,old_total,new_total);
+
+    return 0;
+}
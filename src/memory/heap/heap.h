@@ -5,11 +5,15 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#define HEAP_BLOCK_TABLE_ENTRY_TAKEN    0x01  // these are the lower 4 bits
+#define HEAP_BLOCK_TABLE_ENTRY_TAKEN    0x01  // bit 0
 #define HEAP_BLOCK_TABLE_ENTRY_FREE     0x00
 
-#define HEAP_BLOCK_HAS_NEXT (1 << 7)    // 7th bit
-#define HEAP_BLOCK_IS_FIRST (1 << 6)    // 6th bit
+#define HEAP_BLOCK_ORDER_SHIFT  1           // bits 1-5 hold the buddy order of a first block
+#define HEAP_BLOCK_ORDER_MASK   (0x1f << HEAP_BLOCK_ORDER_SHIFT)
+#define HEAP_BLOCK_IS_FIRST (1 << 6)    // 6th bit, set only on the first entry of a buddy block
+
+// 2^20 blocks of 4096 bytes covers the whole 4gb address space
+#define HEAP_BUDDY_MAX_ORDER    20
 
 typedef unsigned char HEAP_BLOCK_TABLE_ENTRY;
 
@@ -19,17 +23,55 @@ struct heap_table
     size_t total;   // i.e. total number of entries
 };
 
+// A free buddy block keeps its free list links inside the block itself
+struct heap_free_block
+{
+    struct heap_free_block* next;
+    struct heap_free_block* prev;
+};
+
+struct heap;
+
+// called when the heap has no block left which is big enough for size bytes
+typedef int (*HEAP_GROW_FUNCTION)(struct heap* heap, size_t size);
+
 struct heap
 {
     struct heap_table* table;
     void* saddr;  // start address of the heap data pool
+
+    // free_lists[k] links all free blocks of 2^k heap blocks
+    struct heap_free_block* free_lists[HEAP_BUDDY_MAX_ORDER+1];
+    uint32_t free_orders;   // bit k is set when free_lists[k] is not empty
+
+    // allocation size histograms, indexed by buddy order
+    uint32_t live_allocations[HEAP_BUDDY_MAX_ORDER+1];
+    uint32_t total_allocations[HEAP_BUDDY_MAX_ORDER+1];
+
+    HEAP_GROW_FUNCTION grow;    // optional, the heap table must have room for the grown heap
+};
+
+struct heap_stats
+{
+    uint32_t total_blocks;
+    uint32_t used_blocks;
+    uint32_t free_blocks;
+    uint32_t largest_free_run;  // the biggest number of consecutive free blocks
+    uint32_t fragmentation;     // 0-100, percentage of free blocks outside the largest free run
+
+    uint32_t free_blocks_per_order[HEAP_BUDDY_MAX_ORDER+1];
+    uint32_t live_allocations[HEAP_BUDDY_MAX_ORDER+1];
+    uint32_t total_allocations[HEAP_BUDDY_MAX_ORDER+1];
 };
 
 
 int heap_create(struct heap* heap, void* ptr, void* end, struct heap_table* table);
 void* heap_malloc(struct heap* heap, size_t size);
 void  heap_free(struct heap* heap, void* ptr);
+void* heap_get_allocation_start(struct heap* heap, void* ptr);
+void heap_get_stats(struct heap* heap, struct heap_stats* stats);
+int heap_grow(struct heap* heap, void* new_end);
 
 
 
-#endif
\ No newline at end of file
+#endif
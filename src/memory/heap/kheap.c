@@ -1,37 +1,299 @@
 #include "kheap.h"
 #include "heap.h"
+#include "slab.h"
 #include "config.h"
 #include "kernel.h"
 #include "memory/memory.h"
+#include "string/string.h"
+#include "time/tsc.h"
+#include "status.h"
+#include "memory/frame/frame.h"
 
 struct heap kernel_heap;
 struct heap_table kernel_heap_table;
 
+// the heap owns the ram from its start up to kernel_heap_end and may grow up to kernel_heap_max_end
+static void* kernel_heap_end = 0;
+static void* kernel_heap_max_end = 0;
 
-void kheap_init()
+static struct slab_cache kheap_size_caches[KHEAP_TOTAL_SIZE_CLASSES];
+static const char* kheap_size_cache_names[KHEAP_TOTAL_SIZE_CLASSES] =
 {
-    int total_table_entries = CHUCHUOS_HEAP_SIZE_BYTES / CHUCHUOS_HEAP_BLOCK_SIZE;
-    kernel_heap_table.entries = (HEAP_BLOCK_TABLE_ENTRY*)(CHUCHUOS_HEAP_TABLE_ADDRESS);// assigning starting address of heap table
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+    "kmalloc-256", "kmalloc-512", "kmalloc-1024", "kmalloc-2048"
+};
+
+#if CHUCHUOS_KHEAP_PROFILE
+#define KHEAP_PROFILE_TOTAL_EVENTS  256
+
+struct kheap_profile_record
+{
+    void* ptr;
+    void* caller;
+    uint32_t size;  // 0 for a kfree event
+    uint64_t timestamp;
+};
+
+struct kheap_profile_site
+{
+    void* caller;
+    uint32_t allocations;
+    uint32_t bytes;
+    uint32_t live;
+};
+
+// allocations which were not freed yet, a leak shows up here with its caller
+static struct kheap_profile_record kheap_profile_live[CHUCHUOS_KHEAP_PROFILE_MAX_LIVE];
+// allocation hot spots
+static struct kheap_profile_site kheap_profile_sites[CHUCHUOS_KHEAP_PROFILE_MAX_SITES];
+// ring buffer of the most recent kmalloc/kfree calls
+static struct kheap_profile_record kheap_profile_events[KHEAP_PROFILE_TOTAL_EVENTS];
+static uint32_t kheap_profile_next_event = 0;
+#endif
+
+
+static void kheap_init_size_caches()
+{
+    size_t size = CHUCHUOS_SLAB_MIN_SIZE;
+
+    for(int i=0; i<KHEAP_TOTAL_SIZE_CLASSES; i++)
+    {
+        if(slab_cache_init(&kheap_size_caches[i],&kernel_heap,kheap_size_cache_names[i],size) < 0)
+        {
+            print("Failed to create kmalloc cache\n");
+        }
+        size *= 2;
+    }
+}
+
+int kheap_init_region(void* saddr, void* end, HEAP_BLOCK_TABLE_ENTRY* table_entries)
+{
+    int total_table_entries = (end - saddr) / CHUCHUOS_HEAP_BLOCK_SIZE;
+    kernel_heap_table.entries = table_entries;  // assigning starting address of heap table
     kernel_heap_table.total = total_table_entries;
 
-    void* end = (void*)(CHUCHUOS_HEAP_ADDRESS + CHUCHUOS_HEAP_SIZE_BYTES);
-    int res = heap_create(&kernel_heap,(void*)CHUCHUOS_HEAP_ADDRESS,end,&kernel_heap_table);
+    int res = heap_create(&kernel_heap,saddr,end,&kernel_heap_table);
 
     if(res < 0)
     {
         print("Failed to create heap\n");
+        return res;
+    }
+
+    kheap_init_size_caches();
+    return res;
+}
+
+static int kheap_grow(struct heap* heap, size_t size)
+{
+    // take the physical frames right after the heap, so the heap stays one contiguous pool.
+    // Other frames are handed out from the top of the same ram, they only get in the way
+    // once the two meet
+    size_t grow_size = size > CHUCHUOS_HEAP_GROW_SIZE ? size : CHUCHUOS_HEAP_GROW_SIZE;
+    void* new_end = kernel_heap_end + grow_size;
+
+    if(new_end > kernel_heap_max_end || new_end < kernel_heap_end)
+    {
+        new_end = kernel_heap_max_end;
+    }
+
+    if(new_end <= kernel_heap_end)
+    {
+        return -ENOMEM;
+    }
+
+    if(frame_claim(kernel_heap_end,(new_end - kernel_heap_end) / CHUCHUOS_FRAME_SIZE) < 0)
+    {
+        // not a whole step left, settle for what the allocation needs. Nothing is remembered
+        // on failure, the frames may be free again by the next try
+        new_end = kernel_heap_end + ((size + CHUCHUOS_FRAME_SIZE - 1) & ~(CHUCHUOS_FRAME_SIZE - 1));
+        if(new_end > kernel_heap_max_end || new_end <= kernel_heap_end)
+        {
+            return -ENOMEM;
+        }
+
+        if(frame_claim(kernel_heap_end,(new_end - kernel_heap_end) / CHUCHUOS_FRAME_SIZE) < 0)
+        {
+            return -ENOMEM;
+        }
+    }
+
+    int res = heap_grow(heap,new_end);
+    if(res == 0)
+    {
+        kernel_heap_end = new_end;
+    }
+
+    return res;
+}
+
+int kheap_init()
+{
+    // frame_init must have run, the heap is sized from the bios memory map
+    void* saddr = (void*)(uintptr_t)CHUCHUOS_HEAP_ADDRESS;
+    void* max_end = frame_get_usable_end(saddr);
+    int res = 0;
+
+    if(max_end <= saddr)
+    {
+        print("No usable memory for the heap\n");
+        return -ENOMEM;
+    }
+
+    // the table needs one entry per block the heap can ever grow to
+    uint32_t max_blocks = (max_end - saddr) / CHUCHUOS_HEAP_BLOCK_SIZE;
+    uint32_t table_frames = (max_blocks * sizeof(HEAP_BLOCK_TABLE_ENTRY) + CHUCHUOS_FRAME_SIZE - 1) / CHUCHUOS_FRAME_SIZE;
+    HEAP_BLOCK_TABLE_ENTRY* table = frame_alloc_contiguous(table_frames);
+
+    void* end = saddr + CHUCHUOS_HEAP_INITIAL_SIZE;
+    if(end > max_end)
+    {
+        end = max_end;
+    }
+
+    if(!table || frame_claim(saddr,(end - saddr) / CHUCHUOS_FRAME_SIZE) < 0)
+    {
+        print("Failed to reserve memory for the heap\n");
+        return -ENOMEM;
+    }
+
+    res = kheap_init_region(saddr,end,table);
+    if(res < 0)
+    {
+        return res;
+    }
+
+    kernel_heap_end = end;
+    kernel_heap_max_end = max_end;
+    kernel_heap.grow = kheap_grow;
+    return 0;
+}
+
+#if CHUCHUOS_KHEAP_PROFILE
+static void kheap_profile_event(void* ptr, void* caller, uint32_t size, uint64_t timestamp)
+{
+    struct kheap_profile_record* event = &kheap_profile_events[kheap_profile_next_event % KHEAP_PROFILE_TOTAL_EVENTS];
+    event->ptr = ptr;
+    event->caller = caller;
+    event->size = size;
+    event->timestamp = timestamp;
+    kheap_profile_next_event++;
+}
+
+static struct kheap_profile_site* kheap_profile_get_site(void* caller)
+{
+    for(int i=0; i<CHUCHUOS_KHEAP_PROFILE_MAX_SITES; i++)
+    {
+        struct kheap_profile_site* site = &kheap_profile_sites[i];
+        if(site->caller == caller || site->caller == 0)
+        {
+            site->caller = caller;
+            return site;
+        }
+    }
+
+    return 0;
+}
+
+static void kheap_profile_alloc(void* ptr, uint32_t size, void* caller)
+{
+    uint64_t timestamp = tsc_read();
+    kheap_profile_event(ptr,caller,size,timestamp);
+
+    struct kheap_profile_site* site = kheap_profile_get_site(caller);
+    if(site)
+    {
+        site->allocations++;
+        site->bytes += size;
+        site->live++;
+    }
+
+    for(int i=0; i<CHUCHUOS_KHEAP_PROFILE_MAX_LIVE; i++)
+    {
+        struct kheap_profile_record* record = &kheap_profile_live[i];
+        if(record->ptr == 0)
+        {
+            record->ptr = ptr;
+            record->caller = caller;
+            record->size = size;
+            record->timestamp = timestamp;
+            break;
+        }
+    }
+}
+
+static void kheap_profile_free(void* ptr, void* caller)
+{
+    kheap_profile_event(ptr,caller,0,tsc_read());
+
+    for(int i=0; i<CHUCHUOS_KHEAP_PROFILE_MAX_LIVE; i++)
+    {
+        struct kheap_profile_record* record = &kheap_profile_live[i];
+        if(record->ptr == ptr)
+        {
+            struct kheap_profile_site* site = kheap_profile_get_site(record->caller);
+            if(site)
+            {
+                site->live--;
+            }
+
+            memset(record,0,sizeof(struct kheap_profile_record));
+            break;
+        }
     }
 }
+#endif
+
+static struct slab_cache* kheap_get_size_cache(size_t size)
+{
+    size_t class_size = CHUCHUOS_SLAB_MIN_SIZE;
+
+    for(int i=0; i<KHEAP_TOTAL_SIZE_CLASSES; i++)
+    {
+        if(size <= class_size)
+        {
+            return &kheap_size_caches[i];
+        }
+        class_size *= 2;
+    }
+
+    return 0;
+}
+
+static void* kheap_malloc(size_t size, void* caller)
+{
+    void* ptr = 0;
+
+    // small objects are packed into slabs instead of taking a whole heap block
+    struct slab_cache* cache = kheap_get_size_cache(size);
+    if(cache)
+    {
+        ptr = slab_alloc(cache);
+    }
+    else
+    {
+        ptr = heap_malloc(&kernel_heap, size);
+    }
+
+#if CHUCHUOS_KHEAP_PROFILE
+    if(ptr)
+    {
+        kheap_profile_alloc(ptr,size,caller);
+    }
+#endif
+
+    return ptr;
+}
   
 void* kmalloc(size_t size)
 {
-    return (heap_malloc(&kernel_heap, size));
+    return kheap_malloc(size,__builtin_return_address(0));
 }
 
 
 void* kzalloc(size_t size)
 {
-    void* ptr = kmalloc(size);
+    void* ptr = kheap_malloc(size,__builtin_return_address(0));
     if(!ptr)
     {
         return 0;
@@ -44,6 +306,159 @@ void* kzalloc(size_t size)
 
 void kfree(void* ptr)
 {
+#if CHUCHUOS_KHEAP_PROFILE
+    if(ptr)
+    {
+        kheap_profile_free(ptr,__builtin_return_address(0));
+    }
+#endif
+
+    struct slab_cache* cache = slab_get_cache(&kernel_heap,ptr);
+    if(cache)
+    {
+        slab_free(cache,ptr);
+        return;
+    }
+
    heap_free(&kernel_heap,ptr);
 }
 
+struct slab_cache* kcache_create(const char* name, size_t size)
+{
+    struct slab_cache* cache = kzalloc(sizeof(struct slab_cache));
+    if(!cache)
+    {
+        return 0;
+    }
+
+    if(slab_cache_init(cache,&kernel_heap,name,size) < 0)
+    {
+        kfree(cache);
+        return 0;
+    }
+
+    return cache;
+}
+
+void* kcache_zalloc(struct slab_cache* cache)
+{
+    void* ptr = slab_alloc(cache);
+    if(!ptr)
+    {
+        return 0;
+    }
+    memset(ptr,0,cache->object_size);
+
+#if CHUCHUOS_KHEAP_PROFILE
+    kheap_profile_alloc(ptr,cache->object_size,__builtin_return_address(0));
+#endif
+
+    return ptr;
+}
+
+void kcache_free(struct slab_cache* cache, void* ptr)
+{
+#if CHUCHUOS_KHEAP_PROFILE
+    if(ptr)
+    {
+        kheap_profile_free(ptr,__builtin_return_address(0));
+    }
+#endif
+
+    slab_free(cache,ptr);
+}
+
+void kheap_stats(struct kheap_stats* stats)
+{
+    memset(stats,0,sizeof(struct kheap_stats));
+    heap_get_stats(&kernel_heap,&stats->heap);
+
+    for(int i=0; i<KHEAP_TOTAL_SIZE_CLASSES; i++)
+    {
+        stats->slab_objects_in_use[i] = kheap_size_caches[i].objects_in_use;
+        stats->slab_total_allocations[i] = kheap_size_caches[i].total_allocations;
+        stats->slab_total_slabs[i] = kheap_size_caches[i].total_slabs;
+    }
+}
+
+static void kheap_print_value(const char* label, uint32_t value, int base)
+{
+    char buf[33];
+
+    print(label);
+    print(itoa(value,buf,base));
+}
+
+void kheap_print_stats()
+{
+    struct kheap_stats stats;
+    kheap_stats(&stats);
+
+    kheap_print_value("heap used blocks: ",stats.heap.used_blocks,10);
+    kheap_print_value(" free: ",stats.heap.free_blocks,10);
+    kheap_print_value(" largest free run: ",stats.heap.largest_free_run,10);
+    kheap_print_value(" fragmentation %: ",stats.heap.fragmentation,10);
+    print("\n");
+
+    for(int i=0; i<=HEAP_BUDDY_MAX_ORDER; i++)
+    {
+        if(!stats.heap.total_allocations[i])
+        {
+            continue;
+        }
+
+        kheap_print_value("  blocks 2^",i,10);
+        kheap_print_value(" live: ",stats.heap.live_allocations[i],10);
+        kheap_print_value(" total: ",stats.heap.total_allocations[i],10);
+        print("\n");
+    }
+
+    for(int i=0; i<KHEAP_TOTAL_SIZE_CLASSES; i++)
+    {
+        if(!stats.slab_total_allocations[i])
+        {
+            continue;
+        }
+
+        print("  ");
+        print(kheap_size_cache_names[i]);
+        kheap_print_value(" live: ",stats.slab_objects_in_use[i],10);
+        kheap_print_value(" total: ",stats.slab_total_allocations[i],10);
+        kheap_print_value(" slabs: ",stats.slab_total_slabs[i],10);
+        print("\n");
+    }
+}
+
+void kheap_profile_dump()
+{
+#if CHUCHUOS_KHEAP_PROFILE
+    print("kmalloc call sites:\n");
+    for(int i=0; i<CHUCHUOS_KHEAP_PROFILE_MAX_SITES && kheap_profile_sites[i].caller; i++)
+    {
+        struct kheap_profile_site* site = &kheap_profile_sites[i];
+        kheap_print_value("  0x",(uintptr_t)site->caller,16);
+        kheap_print_value(" allocs: ",site->allocations,10);
+        kheap_print_value(" bytes: ",site->bytes,10);
+        kheap_print_value(" live: ",site->live,10);
+        print("\n");
+    }
+
+    print("outstanding allocations:\n");
+    for(int i=0; i<CHUCHUOS_KHEAP_PROFILE_MAX_LIVE; i++)
+    {
+        struct kheap_profile_record* record = &kheap_profile_live[i];
+        if(!record->ptr)
+        {
+            continue;
+        }
+
+        kheap_print_value("  0x",(uintptr_t)record->ptr,16);
+        kheap_print_value(" size: ",record->size,10);
+        kheap_print_value(" from: 0x",(uintptr_t)record->caller,16);
+        kheap_print_value(" at tsc: ",(uint32_t)record->timestamp,10);
+        print("\n");
+    }
+#else
+    print("kheap profiling is disabled, set CHUCHUOS_KHEAP_PROFILE\n");
+#endif
+}
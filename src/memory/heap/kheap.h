@@ -3,13 +3,39 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "heap.h"
 
-void kheap_init();
+// one slab cache per power of two from CHUCHUOS_SLAB_MIN_SIZE to CHUCHUOS_SLAB_MAX_SIZE
+#define KHEAP_TOTAL_SIZE_CLASSES    8
+
+struct slab_cache;
+
+struct kheap_stats
+{
+    struct heap_stats heap;
+
+    // histograms of small allocations, indexed by size class
+    uint32_t slab_objects_in_use[KHEAP_TOTAL_SIZE_CLASSES];
+    uint32_t slab_total_allocations[KHEAP_TOTAL_SIZE_CLASSES];
+    uint32_t slab_total_slabs[KHEAP_TOTAL_SIZE_CLASSES];
+};
+
+int kheap_init();
+int kheap_init_region(void* saddr, void* end, HEAP_BLOCK_TABLE_ENTRY* table_entries);
 void* kmalloc(size_t size);
 void kfree(void* ptr);
 void* kzalloc(size_t size);
 
+// named caches for kernel objects which are allocated and freed often
+struct slab_cache* kcache_create(const char* name, size_t size);
+void* kcache_zalloc(struct slab_cache* cache);
+void kcache_free(struct slab_cache* cache, void* ptr);
+
+void kheap_stats(struct kheap_stats* stats);
+void kheap_print_stats();
+void kheap_profile_dump();
+
 
 
 
-#endif
\ No newline at end of file
+#endif
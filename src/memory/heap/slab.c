@@ -0,0 +1,182 @@
+#include "slab.h"
+#include "config.h"
+#include "status.h"
+#include "memory/memory.h"
+
+// objects start after the slab header, rounded so they stay 16 byte aligned
+#define SLAB_HEADER_SIZE    ((sizeof(struct slab) + 15) & ~15)
+
+//--------------------------------------------------------------------------------
+static void slab_list_push(struct slab** list, struct slab* slab)
+{
+    slab->prev = 0;
+    slab->next = *list;
+
+    if(slab->next)
+    {
+        slab->next->prev = slab;
+    }
+
+    *list = slab;
+}
+
+//--------------------------------------------------------------------------------
+static void slab_list_remove(struct slab** list, struct slab* slab)
+{
+    if(slab->prev)
+    {
+        slab->prev->next = slab->next;
+    }
+    else
+    {
+        *list = slab->next;
+    }
+
+    if(slab->next)
+    {
+        slab->next->prev = slab->prev;
+    }
+
+    slab->next = 0;
+    slab->prev = 0;
+}
+
+//--------------------------------------------------------------------------------
+int slab_cache_init(struct slab_cache* cache, struct heap* heap, const char* name, size_t object_size)
+{
+    int res = 0;
+
+    memset(cache,0,sizeof(struct slab_cache));
+
+    // every object must at least be able to hold the freelist link
+    if(object_size < sizeof(void*))
+    {
+        object_size = sizeof(void*);
+    }
+    object_size = (object_size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+    // a slab is the smallest power of two number of heap blocks holding enough objects
+    uint32_t slab_size = CHUCHUOS_HEAP_BLOCK_SIZE;
+    while((slab_size - SLAB_HEADER_SIZE) / object_size < CHUCHUOS_SLAB_MIN_OBJECTS)
+    {
+        slab_size *= 2;
+
+        if(slab_size > CHUCHUOS_HEAP_BLOCK_SIZE * 8)
+        {
+            res = -EINVARG;
+            goto out;
+        }
+    }
+
+    for(int i=0; i<sizeof(cache->name)-1 && name[i] != 0; i++)
+    {
+        cache->name[i] = name[i];
+    }
+
+    cache->heap = heap;
+    cache->object_size = object_size;
+    cache->slab_size = slab_size;
+    cache->objects_per_slab = (slab_size - SLAB_HEADER_SIZE) / object_size;
+
+out:
+    return res;
+}
+
+//--------------------------------------------------------------------------------
+static struct slab* slab_new(struct slab_cache* cache)
+{
+    struct slab* slab = heap_malloc(cache->heap,cache->slab_size);
+    if(!slab)
+    {
+        return 0;
+    }
+
+    slab->cache = cache;
+    slab->in_use = 0;
+    slab->free_objects = 0;
+
+    // thread the freelist backwards so the first allocation gets the lowest address
+    char* objects = (char*)slab + SLAB_HEADER_SIZE;
+    for(int i=cache->objects_per_slab-1; i>=0; i--)
+    {
+        void** object = (void**)(objects + (i*cache->object_size));
+        *object = slab->free_objects;
+        slab->free_objects = object;
+    }
+
+    slab_list_push(&cache->partial,slab);
+    cache->total_slabs++;
+    return slab;
+}
+
+//--------------------------------------------------------------------------------
+void* slab_alloc(struct slab_cache* cache)
+{
+    struct slab* slab = cache->partial;
+
+    if(!slab)
+    {
+        slab = slab_new(cache);
+        if(!slab)
+        {
+            return 0;
+        }
+    }
+
+    void** object = slab->free_objects;
+    slab->free_objects = *object;
+    slab->in_use++;
+    cache->objects_in_use++;
+    cache->total_allocations++;
+
+    if(!slab->free_objects)
+    {
+        slab_list_remove(&cache->partial,slab);
+        slab_list_push(&cache->full,slab);
+    }
+
+    return object;
+}
+
+//--------------------------------------------------------------------------------
+void slab_free(struct slab_cache* cache, void* ptr)
+{
+    struct slab* slab = heap_get_allocation_start(cache->heap,ptr);
+    if(!slab || slab->cache != cache)
+    {
+        return;
+    }
+
+    if(!slab->free_objects)
+    {
+        // slab was full, it can serve allocations again
+        slab_list_remove(&cache->full,slab);
+        slab_list_push(&cache->partial,slab);
+    }
+
+    *(void**)ptr = slab->free_objects;
+    slab->free_objects = ptr;
+    slab->in_use--;
+    cache->objects_in_use--;
+
+    // give empty slabs back to the heap, but keep the last one to avoid thrashing
+    if(slab->in_use == 0 && (slab->next || slab->prev))
+    {
+        slab_list_remove(&cache->partial,slab);
+        heap_free(cache->heap,slab);
+        cache->total_slabs--;
+    }
+}
+
+//--------------------------------------------------------------------------------
+struct slab_cache* slab_get_cache(struct heap* heap, void* ptr)
+{
+    // objects never sit at the start of their slab, the header does
+    struct slab* slab = heap_get_allocation_start(heap,ptr);
+    if(!slab || (void*)slab == ptr)
+    {
+        return 0;
+    }
+
+    return slab->cache;
+}
@@ -0,0 +1,44 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "heap.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// A slab is one buddy block of the heap, carved into equally sized objects
+struct slab
+{
+    struct slab_cache* cache;
+    struct slab* next;
+    struct slab* prev;
+
+    void* free_objects;     // freelist, the link is stored inside each free object
+    uint32_t in_use;
+};
+
+struct slab_cache
+{
+    char name[20];
+    struct heap* heap;
+
+    size_t object_size;
+    uint32_t objects_per_slab;
+    uint32_t slab_size;     // bytes of heap taken by one slab
+
+    struct slab* partial;   // slabs with at least one free object
+    struct slab* full;      // slabs without any free object
+
+    uint32_t total_slabs;
+    uint32_t objects_in_use;
+    uint32_t total_allocations;
+};
+
+
+int slab_cache_init(struct slab_cache* cache, struct heap* heap, const char* name, size_t object_size);
+void* slab_alloc(struct slab_cache* cache);
+void slab_free(struct slab_cache* cache, void* ptr);
+struct slab_cache* slab_get_cache(struct heap* heap, void* ptr);
+
+
+
+#endif
@@ -4,6 +4,12 @@ section .asm
 
 global paging_load_directory
 global enable_paging
+global paging_get_cpu_features
+global paging_enable_pse
+global paging_enable_pge
+global paging_disable_pge
+global paging_flush_tlb
+global paging_invalidate_page
 
 paging_load_directory:
     push ebp
@@ -21,4 +27,63 @@ enable_paging:
     or eax, 0x80000000   ; enabling 31st bit 
     mov cr0, eax
     pop ebp
-    ret 
\ No newline at end of file
+    ret 
+
+paging_get_cpu_features:
+    push ebp
+    mov ebp,esp
+    push ebx        ; cpuid clobbers ebx, which the caller expects to be preserved
+    mov eax, 1
+    cpuid
+    mov eax, edx    ; feature flags, bit 3 is PSE
+    pop ebx
+    pop ebp
+    ret
+
+
+paging_enable_pse:
+    push ebp
+    mov ebp,esp
+    mov eax, cr4
+    or eax, 0x10    ; enabling 4th bit, allows 4mb pages in the page directory
+    mov cr4, eax
+    pop ebp
+    ret
+
+
+paging_enable_pge:
+    push ebp
+    mov ebp,esp
+    mov eax, cr4
+    or eax, 0x80    ; enabling 7th bit, global pages are kept in the tlb on cr3 reloads
+    mov cr4, eax
+    pop ebp
+    ret
+
+
+paging_disable_pge:
+    push ebp
+    mov ebp,esp
+    mov eax, cr4
+    and eax, ~0x80  ; clearing PGE also flushes the global tlb entries
+    mov cr4, eax
+    pop ebp
+    ret
+
+
+paging_flush_tlb:
+    push ebp
+    mov ebp,esp
+    mov eax, cr3    ; writing cr3 back drops all non global tlb entries
+    mov cr3, eax
+    pop ebp
+    ret
+
+
+paging_invalidate_page:
+    push ebp
+    mov ebp,esp
+    mov eax, [ebp+8]    ; virtual address of the page
+    invlpg [eax]        ; drops only the tlb entry of that page
+    pop ebp
+    ret
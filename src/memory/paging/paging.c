@@ -1,40 +1,298 @@
 #include "paging.h"
 #include "memory/heap/kheap.h"
+#include "memory/frame/frame.h"
+#include "memory/memory.h"
 #include "status.h"
+#include "config.h"
+#include "kernel.h"
 
 extern void paging_load_directory(uint32_t* directory);
+extern uint32_t paging_get_cpu_features();
+extern void paging_enable_pse();
+extern void paging_enable_pge();
+extern void paging_disable_pge();
+extern void paging_flush_tlb();
+extern void paging_invalidate_page(void* virt_addr);
 
 static uint32_t* current_directory = 0;
+static struct paging_tlb_stats paging_tlb_stats;
+static int paging_pse_state = -1;   // -1 not probed yet, 0 unsupported, 1 CR4.PSE enabled
+static int paging_pge_state = -1;   // same for CR4.PGE
+
+// directory entries of the kernel identity map, copied into every directory
+static uint32_t* paging_kernel_entries = 0;
+static uint32_t paging_kernel_total_entries = 0;
+// every chunk whose directory copied the kernel entries, they all see a change to one of them
+static struct paging_4gb_chunk* paging_shared_chunks = 0;
+
+//------------------------------------------------------------------------------------------------
+bool paging_large_pages_supported()
+{
+    if(paging_pse_state < 0)
+    {
+        paging_pse_state = (paging_get_cpu_features() & PAGING_CPU_FEATURE_PSE) ? 1 : 0;
+
+        if(paging_pse_state)
+        {
+            paging_enable_pse();
+        }
+    }
+
+    return paging_pse_state == 1;
+}
+
+//------------------------------------------------------------------------------------------------
+bool paging_global_pages_supported()
+{
+    if(paging_pge_state < 0)
+    {
+        paging_pge_state = (paging_get_cpu_features() & PAGING_CPU_FEATURE_PGE) ? 1 : 0;
+
+        if(paging_pge_state)
+        {
+            paging_enable_pge();
+        }
+    }
+
+    return paging_pge_state == 1;
+}
+
+//------------------------------------------------------------------------------------------------
+static void* paging_alloc_frame()
+{
+    // a new frame is written through its identity mapping before anything else maps it, which
+    // only the kernel entries guarantee. A frame outside of them would fault, and the fault
+    // handler would need another frame to map it, so it is refused instead
+    void* frame = frame_alloc();
+    if(frame && paging_kernel_entries && (uint32_t)frame >= paging_kernel_total_entries * PAGING_LARGE_PAGE_SIZE)
+    {
+        frame_free(frame);
+        return 0;
+    }
+
+    return frame;
+}
+
+//------------------------------------------------------------------------------------------------
+static uint32_t* paging_new_table()
+{
+    // directories and page tables come straight from the frame allocator, so the page fault
+    // handler can create them without going through the heap which may itself fault
+    uint32_t* table = paging_alloc_frame();
+    if(!table)
+    {
+        return 0;
+    }
+
+    memset(table,0,PAGING_PAGE_SIZE);
+    return table;
+}
+
+static void paging_free_directory(uint32_t* directory);
+
+//------------------------------------------------------------------------------------------------
+static void paging_identity_map_directory_entry(uint32_t* directory, uint32_t directory_index, uint32_t* table, uint32_t flags)
+{
+    // maps the 4mb behind directory_index onto the same physical addresses
+    uint32_t base = directory_index * PAGING_LARGE_PAGE_SIZE;
+
+    if(!table)
+    {
+        directory[directory_index] = base | flags | PAGING_IS_WRITEABLE | PAGING_IS_4MB;
+        return;
+    }
+
+    for(int b=0; b<PAGING_TOTAL_ENTRIES_PER_TABLE; b++)
+    {
+        table[b] = (base + (b * PAGING_PAGE_SIZE)) | flags;
+    }
+
+    directory[directory_index] = (uint32_t)table | flags | PAGING_IS_WRITEABLE;
+}
+
+//------------------------------------------------------------------------------------------------
+static int paging_fill_lazy_directory_entry(uint32_t* directory, uint32_t directory_index)
+{
+    // first touch of a region marked PAGING_LAZY_IDENTITY
+    uint32_t flags = (directory[directory_index] & PAGING_ENTRY_FLAGS_MASK & ~PAGING_LAZY_MASK) | PAGING_IS_PRESENT;
+    uint32_t* table = 0;
+
+    if(!paging_large_pages_supported())
+    {
+        table = paging_new_table();
+        if(!table)
+        {
+            return -ENOMEM;
+        }
+    }
+
+    paging_identity_map_directory_entry(directory,directory_index,table,flags);
+    return 0;
+}
+
+//------------------------------------------------------------------------------------------------
+static int paging_init_kernel_entries(uint32_t flags)
+{
+    // the kernel image, the frames page tables come from and the whole kernel heap are identity
+    // mapped once, as global pages, and every directory points at these same entries. Switching
+    // directories then keeps the kernel translations in the tlb. frame_alloc stays below
+    // frame_get_alloc_end, so every frame it hands out is covered as well
+    uint32_t end = (uint32_t)frame_get_alloc_end();
+    uint32_t total_entries = (end + PAGING_LARGE_PAGE_SIZE - 1) / PAGING_LARGE_PAGE_SIZE;
+
+    if(total_entries < CHUCHUOS_HEAP_ADDRESS / PAGING_LARGE_PAGE_SIZE)
+    {
+        total_entries = CHUCHUOS_HEAP_ADDRESS / PAGING_LARGE_PAGE_SIZE;
+    }
+
+    uint32_t* entries = paging_new_table();
+    if(!entries)
+    {
+        return -ENOMEM;
+    }
+
+    if(paging_global_pages_supported())
+    {
+        flags |= PAGING_IS_GLOBAL;
+    }
+
+    for(int i=0; i<total_entries; i++)
+    {
+        uint32_t* table = 0;
+
+        if(!paging_large_pages_supported())
+        {
+            table = paging_new_table();
+            if(!table)
+            {
+                paging_free_directory(entries);
+                return -ENOMEM;
+            }
+        }
+
+        paging_identity_map_directory_entry(entries,i,table,flags | PAGING_IS_PRESENT);
+    }
+
+    for(int i=0; i<total_entries; i++)
+    {
+        entries[i] |= PAGING_SHARED;
+    }
+
+    paging_kernel_entries = entries;
+    paging_kernel_total_entries = total_entries;
+    return 0;
+}
+
+//------------------------------------------------------------------------------------------------
+static struct paging_4gb_chunk* paging_create_shared_4gb_chunk(uint8_t flags, bool lazy)
+{
+    // the kernel entries come from the shared set, the rest of the 4gb is identity mapped
+    // either right away or by the page fault handler
+    uint32_t* directory = 0;
+    struct paging_4gb_chunk* chunk_4gb = 0;
+
+    if(!paging_kernel_entries && paging_init_kernel_entries(flags) < 0)
+    {
+        return 0;
+    }
+
+    directory = paging_new_table();
+    if(!directory)
+    {
+        return 0;
+    }
+
+    for(int i=0; i<PAGING_TOTAL_ENTRIES_PER_TABLE; i++)
+    {
+        if(i < paging_kernel_total_entries)
+        {
+            directory[i] = paging_kernel_entries[i];
+        }
+        else
+        {
+            // the fill below takes its flags from the entry, so both ways map the same
+            directory[i] = PAGING_LAZY_IDENTITY | (flags & ~PAGING_IS_PRESENT) | PAGING_IS_WRITEABLE;
+
+            if(!lazy && paging_fill_lazy_directory_entry(directory,i) < 0)
+            {
+                goto out;
+            }
+        }
+    }
+
+    chunk_4gb = kzalloc(sizeof(struct paging_4gb_chunk));
+    if(!chunk_4gb)
+    {
+        goto out;
+    }
+
+    chunk_4gb->directory_address = directory;
+    chunk_4gb->next_shared = paging_shared_chunks;
+    paging_shared_chunks = chunk_4gb;
+
+out:
+    if(!chunk_4gb)
+    {
+        paging_free_directory(directory);
+    }
+
+    return chunk_4gb;
+}
 
 //------------------------------------------------------------------------------------------------
 struct paging_4gb_chunk* paging_create_new_4gb_chunk(uint8_t flags)
 {
-    //1. First create directory
-    uint32_t* directory = kzalloc(sizeof(uint32_t)*PAGING_TOTAL_ENTRIES_PER_TABLE);
+    return paging_create_shared_4gb_chunk(flags,CHUCHUOS_PAGING_DEMAND);
+}
 
-    int offset = 0;
+//------------------------------------------------------------------------------------------------
+struct paging_4gb_chunk* paging_create_new_sparse_4gb_chunk(uint8_t flags)
+{
+    // only the directory is built, every 4mb region outside the kernel gets mapped by the page
+    // fault handler, which itself relies on the shared kernel entries being present
+    return paging_create_shared_4gb_chunk(flags,true);
+}
+
+//------------------------------------------------------------------------------------------------
+struct paging_4gb_chunk* paging_create_new_4gb_chunk_with_page_size(uint8_t flags, bool large_pages)
+{
+    bool use_large_pages = large_pages && paging_large_pages_supported();
+
+    //1. First create directory
+    uint32_t* directory = paging_new_table();
+    if(!directory)
+    {
+        return 0;
+    }
 
-    //2. Now need to populate the directory, but to do that we need to initialize page table and 
-    //   populate their values as well
+    //2. Now need to populate the directory. With 4mb pages the directory maps the whole 4gb by
+    //   itself, otherwise we need to initialize page tables and populate their values as well
 
     for(int i=0; i<PAGING_TOTAL_ENTRIES_PER_TABLE; i++)
     {
         //3a) initialize the page_table_entry
         //         Each page table has 1024 entries of address | flags
-        uint32_t* page_table_entry = kzalloc(sizeof(uint32_t)*PAGING_TOTAL_ENTRIES_PER_TABLE);
+        uint32_t* page_table_entry = 0;
 
-        for(int b=0; b<PAGING_TOTAL_ENTRIES_PER_TABLE;b++)
+        if(!use_large_pages)
         {
-            page_table_entry[b] = (offset + (b * PAGING_PAGE_SIZE)) | flags;
+            page_table_entry = paging_new_table();
+            if(!page_table_entry)
+            {
+                paging_free_directory(directory);
+                return 0;
+            }
         }
 
-        offset += (PAGING_TOTAL_ENTRIES_PER_TABLE*PAGING_PAGE_SIZE);
-
-        directory[i] = (uint32_t)page_table_entry | flags | PAGING_IS_WRITEABLE;
-
+        paging_identity_map_directory_entry(directory,i,page_table_entry,flags);
     }
 
     struct paging_4gb_chunk* chunk_4gb = kzalloc(sizeof(struct paging_4gb_chunk));
+    if(!chunk_4gb)
+    {
+        paging_free_directory(directory);
+        return 0;
+    }
 
     chunk_4gb->directory_address = directory;
 
@@ -42,9 +300,57 @@ struct paging_4gb_chunk* paging_create_new_4gb_chunk(uint8_t flags)
 
 }
 
+//------------------------------------------------------------------------------------------------
+static void paging_free_table(uint32_t* table)
+{
+    // frames handed out for demand zero pages belong to the table
+    for(int i=0; i<PAGING_TOTAL_ENTRIES_PER_TABLE; i++)
+    {
+        if((table[i] & PAGING_IS_PRESENT) && (table[i] & PAGING_LAZY_ZERO))
+        {
+            frame_free((void*)(table[i] & 0xfffff000));
+        }
+    }
+
+    frame_free(table);
+}
+
+//------------------------------------------------------------------------------------------------
+static void paging_free_directory(uint32_t* directory)
+{
+    for(int i=0; i<PAGING_TOTAL_ENTRIES_PER_TABLE; i++)
+    {
+        uint32_t entry = directory[i];
+
+        // shared kernel tables live as long as the kernel
+        if((entry & PAGING_IS_PRESENT) && !(entry & PAGING_IS_4MB) && !(entry & PAGING_SHARED))
+        {
+            paging_free_table((uint32_t*)(entry & 0xfffff000));
+        }
+    }
+
+    frame_free(directory);
+}
+
+//------------------------------------------------------------------------------------------------
+void paging_free_4gb_chunk(struct paging_4gb_chunk* chunk)
+{
+    for(struct paging_4gb_chunk** link = &paging_shared_chunks; *link; link = &(*link)->next_shared)
+    {
+        if(*link == chunk)
+        {
+            *link = chunk->next_shared;
+            break;
+        }
+    }
+
+    paging_free_directory(chunk->directory_address);
+    kfree(chunk);
+}
+
 //------------------------------------------------------------------------------------------------
 void paging_switch(uint32_t* directory)
-{   
+{
     // loading a directory requires an assembly function, to enable reqd in cr3 register
     paging_load_directory(directory);
     current_directory = directory;
@@ -81,38 +387,373 @@ int paging_get_indexes(void* virtual_address, uint32_t* directory_index_out, uin
     *directory_index_out = (uint32_t)(virtual_address) / (PAGING_TOTAL_ENTRIES_PER_TABLE * PAGING_PAGE_SIZE);
 
     *table_index_out = ((uint32_t)(virtual_address) % (PAGING_TOTAL_ENTRIES_PER_TABLE * PAGING_PAGE_SIZE)) / PAGING_PAGE_SIZE;
-    
+
 out:
     return res;
 }
 
+//------------------------------------------------------------------------------------------------
+static int paging_split_large_page(uint32_t* directory, uint32_t directory_index)
+{
+    // replaces a 4mb directory entry by a page table mapping the same memory with 4kb pages
+    uint32_t entry = directory[directory_index];
+    uint32_t flags = entry & PAGING_ENTRY_FLAGS_MASK & ~(PAGING_IS_4MB | PAGING_SHARED);
+
+    uint32_t* table = paging_new_table();
+    if(!table)
+    {
+        return -ENOMEM;
+    }
+
+    if(!(entry & PAGING_SHARED))
+    {
+        paging_identity_map_directory_entry(directory,directory_index,table,flags);
+        return 0;
+    }
+
+    // a shared kernel entry stays shared, the table replaces the large page in the kernel
+    // entries and in every directory which copied them
+    paging_identity_map_directory_entry(paging_kernel_entries,directory_index,table,flags);
+    paging_kernel_entries[directory_index] |= PAGING_SHARED;
+
+    for(struct paging_4gb_chunk* chunk = paging_shared_chunks; chunk; chunk = chunk->next_shared)
+    {
+        // the cpu sets accessed and dirty bits per directory, the shared bit tells them apart
+        if(chunk->directory_address[directory_index] & PAGING_SHARED)
+        {
+            chunk->directory_address[directory_index] = paging_kernel_entries[directory_index];
+        }
+    }
+
+    directory[directory_index] = paging_kernel_entries[directory_index];
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------------------------
+static uint32_t* paging_get_table(uint32_t* directory, uint32_t directory_index)
+{
+    // returns the page table behind a directory entry, creating it if the entry has none.
+    // A shared kernel table is returned as is, changes to it show up in every directory
+    uint32_t entry = directory[directory_index];
+
+    if(!(entry & PAGING_IS_PRESENT))
+    {
+        uint32_t* table = paging_new_table();
+        if(!table)
+        {
+            return 0;
+        }
+
+        if(entry & PAGING_LAZY_IDENTITY)
+        {
+            // keep the identity mapping the rest of the region would have got on first touch
+            uint32_t flags = (entry & PAGING_ENTRY_FLAGS_MASK & ~PAGING_LAZY_MASK) | PAGING_IS_PRESENT;
+            paging_identity_map_directory_entry(directory,directory_index,table,flags);
+        }
+        else
+        {
+            directory[directory_index] = (uint32_t)table | PAGING_IS_WRITEABLE | PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL;
+        }
+    }
+    else if(entry & PAGING_IS_4MB)
+    {
+        // a single 4kb mapping inside a large page needs a page table of its own
+        if(paging_split_large_page(directory,directory_index) < 0)
+        {
+            return 0;
+        }
+    }
+
+    return (uint32_t*)(directory[directory_index] & 0xfffff000);
+}
+
+//------------------------------------------------------------------------------------------------
+static void paging_flush_all()
+{
+    // a cr3 reload keeps global pages, toggling CR4.PGE drops them as well
+    if(paging_pge_state == 1)
+    {
+        paging_disable_pge();
+        paging_enable_pge();
+        return;
+    }
+
+    paging_flush_tlb();
+}
+
+//------------------------------------------------------------------------------------------------
+static bool paging_range_is_shared(uint32_t* directory, void* virt_addr, uint32_t total_pages)
+{
+    // whether the pages fall into kernel entries, which every directory uses
+    uint32_t first_page = (uint32_t)virt_addr / PAGING_PAGE_SIZE;
+    uint32_t last_page = first_page + total_pages - 1;
+
+    if(last_page < first_page || last_page >= PAGING_TOTAL_ENTRIES_PER_TABLE * PAGING_TOTAL_ENTRIES_PER_TABLE)
+    {
+        last_page = PAGING_TOTAL_ENTRIES_PER_TABLE * PAGING_TOTAL_ENTRIES_PER_TABLE - 1;
+    }
+
+    for(uint32_t i = first_page / PAGING_TOTAL_ENTRIES_PER_TABLE; i <= last_page / PAGING_TOTAL_ENTRIES_PER_TABLE; i++)
+    {
+        if(directory[i] & PAGING_SHARED)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//------------------------------------------------------------------------------------------------
+static void paging_flush_range(uint32_t* directory, void* virt_addr, uint32_t total_pages)
+{
+    // stale translations matter in the directory the cpu is currently using, which also
+    // holds the shared kernel entries whatever directory they were changed through
+    if(!current_directory || total_pages == 0)
+    {
+        return;
+    }
+
+    if(directory != current_directory && !paging_range_is_shared(directory,virt_addr,total_pages))
+    {
+        return;
+    }
+
+    if(total_pages > CHUCHUOS_PAGING_INVLPG_MAX_PAGES)
+    {
+        paging_flush_all();
+        paging_tlb_stats.full_flushes++;
+        return;
+    }
+
+    for(uint32_t i=0; i<total_pages; i++)
+    {
+        paging_invalidate_page(virt_addr + (i * PAGING_PAGE_SIZE));
+    }
+
+    paging_tlb_stats.page_invalidations += total_pages;
+}
+
+//------------------------------------------------------------------------------------------------
+static int paging_set_range(uint32_t* directory, void* virt_addr, uint32_t total_pages, uint32_t val, uint32_t step)
+{
+    // writes total_pages consecutive entries, val grows by step for every page
+    uint32_t directory_index = 0;
+    uint32_t table_index = 0;
+    uint32_t* table = 0;
+    uint32_t i = 0;
+    int res = 0;
+
+    res = paging_get_indexes(virt_addr,&directory_index,&table_index);
+    if(res < 0)
+    {
+        return res;
+    }
+
+    for(i=0; i<total_pages; i++)
+    {
+        // the table is looked up once per 4mb instead of once per page
+        if(!table)
+        {
+            table = paging_get_table(directory,directory_index);
+            if(!table)
+            {
+                res = -ENOMEM;
+                goto out;
+            }
+        }
+
+        table[table_index] = val + (i * step);
+
+        table_index++;
+        if(table_index == PAGING_TOTAL_ENTRIES_PER_TABLE)
+        {
+            table_index = 0;
+            directory_index++;
+            table = 0;
+
+            if(directory_index == PAGING_TOTAL_ENTRIES_PER_TABLE && i+1 < total_pages)
+            {
+                res = -EINVARG;
+                i++;
+                goto out;
+            }
+        }
+    }
+
+out:
+    // whatever got written so far must become visible, even on failure
+    paging_flush_range(directory,virt_addr,i);
+    return res;
+}
+
 //------------------------------------------------------------------------------------------------
 
 int paging_set(uint32_t* directory, void* virt_addr, uint32_t val)
 {
     // here val = physical address | flags
+    return paging_set_range(directory,virt_addr,1,val,0);
+}
 
-    if(!paging_is_aligned(virt_addr))
+//------------------------------------------------------------------------------------------------
+int paging_map_range(uint32_t* directory, void* virt_addr, void* phys_addr, uint32_t total_pages, uint32_t flags)
+{
+    if(!paging_is_aligned(phys_addr))
     {
         return -EINVARG;
     }
 
+    return paging_set_range(directory,virt_addr,total_pages,(uint32_t)phys_addr | (flags & PAGING_ENTRY_FLAGS_MASK),PAGING_PAGE_SIZE);
+}
+
+//------------------------------------------------------------------------------------------------
+int paging_unmap_range(uint32_t* directory, void* virt_addr, uint32_t total_pages)
+{
     uint32_t directory_index = 0;
     uint32_t table_index = 0;
 
     int res = paging_get_indexes(virt_addr,&directory_index,&table_index);
-
     if(res < 0)
     {
         return res;
     }
 
-    uint32_t entry = directory[directory_index];  
-    uint32_t* table = (uint32_t*)(entry & 0xfffff000);
-    table[table_index] = val;
+    for(uint32_t i=0; i<total_pages; i++)
+    {
+        uint32_t entry = directory[directory_index];
 
+        // a region without a page table has nothing mapped unless it is lazily identity mapped
+        if((entry & PAGING_IS_PRESENT) || (entry & PAGING_LAZY_IDENTITY))
+        {
+            uint32_t* table = paging_get_table(directory,directory_index);
+            if(!table)
+            {
+                res = -ENOMEM;
+                paging_flush_range(directory,virt_addr,i);
+                return res;
+            }
+
+            // frames of demand zero pages belong to the mapping and go back to the allocator
+            if((table[table_index] & PAGING_IS_PRESENT) && (table[table_index] & PAGING_LAZY_ZERO))
+            {
+                frame_free((void*)(table[table_index] & 0xfffff000));
+            }
+
+            table[table_index] = 0;
+        }
+
+        table_index++;
+        if(table_index == PAGING_TOTAL_ENTRIES_PER_TABLE)
+        {
+            table_index = 0;
+            directory_index++;
+
+            if(directory_index == PAGING_TOTAL_ENTRIES_PER_TABLE)
+            {
+                total_pages = i+1;
+                break;
+            }
+        }
+    }
+
+    paging_flush_range(directory,virt_addr,total_pages);
     return 0;
 }
 
+//------------------------------------------------------------------------------------------------
+void* paging_get_physical(uint32_t* directory, void* virt_addr)
+{
+    // returns 0 for addresses without a physical page behind them yet
+    uint32_t address = (uint32_t)virt_addr;
+    uint32_t entry = directory[address / PAGING_LARGE_PAGE_SIZE];
+
+    if(!(entry & PAGING_IS_PRESENT))
+    {
+        // would be identity mapped on first touch
+        return (entry & PAGING_LAZY_IDENTITY) ? virt_addr : 0;
+    }
+
+    if(entry & PAGING_IS_4MB)
+    {
+        return (void*)((entry & ~(PAGING_LARGE_PAGE_SIZE - 1)) | (address & (PAGING_LARGE_PAGE_SIZE - 1)));
+    }
+
+    uint32_t* table = (uint32_t*)(entry & 0xfffff000);
+    uint32_t table_entry = table[(address % PAGING_LARGE_PAGE_SIZE) / PAGING_PAGE_SIZE];
+
+    if(!(table_entry & PAGING_IS_PRESENT))
+    {
+        return 0;
+    }
+
+    return (void*)((table_entry & 0xfffff000) | (address & (PAGING_PAGE_SIZE - 1)));
+}
+
+//------------------------------------------------------------------------------------------------
+void paging_get_tlb_stats(struct paging_tlb_stats* stats)
+{
+    *stats = paging_tlb_stats;
+}
 
+//------------------------------------------------------------------------------------------------
+int paging_set_demand_zero(uint32_t* directory, void* virt_addr, uint32_t total_pages, uint8_t flags)
+{
+    // the pages get a zeroed frame of their own the first time they are touched
+    return paging_set_range(directory,virt_addr,total_pages,PAGING_LAZY_ZERO | (flags & ~PAGING_IS_PRESENT),0);
+}
 
+//------------------------------------------------------------------------------------------------
+int paging_handle_fault(void* fault_address, uint32_t error_code)
+{
+    uint32_t directory_index = 0;
+    uint32_t table_index = 0;
+    uint32_t* directory = current_directory;
+    void* page = (void*)((uint32_t)fault_address & 0xfffff000);
+
+    // a protection violation on a present page is a real error, nothing to map lazily
+    if(!directory || (error_code & PAGING_FAULT_PRESENT))
+    {
+        return -EINVARG;
+    }
+
+    paging_get_indexes(page,&directory_index,&table_index);
+
+    uint32_t entry = directory[directory_index];
+    if(!(entry & PAGING_IS_PRESENT))
+    {
+        if(!(entry & PAGING_LAZY_IDENTITY))
+        {
+            return -EINVARG;
+        }
+
+        // with PSE this is a single store, otherwise a page table for the 4mb region
+        return paging_fill_lazy_directory_entry(directory,directory_index);
+    }
+
+    if(entry & PAGING_IS_4MB)
+    {
+        return -EINVARG;
+    }
+
+    uint32_t* table = (uint32_t*)(entry & 0xfffff000);
+    uint32_t table_entry = table[table_index];
+
+    if((table_entry & PAGING_IS_PRESENT) || !(table_entry & PAGING_LAZY_ZERO))
+    {
+        return -EINVARG;
+    }
+
+    void* frame = paging_alloc_frame();
+    if(!frame)
+    {
+        return -ENOMEM;
+    }
+
+    memset(frame,0,PAGING_PAGE_SIZE);
+
+    // PAGING_LAZY_ZERO stays set, it tells paging_free_4gb_chunk that the frame is ours
+    table[table_index] = (uint32_t)frame | (table_entry & PAGING_ENTRY_FLAGS_MASK) | PAGING_IS_PRESENT;
+
+    return 0;
+}
@@ -7,6 +7,16 @@
 
 
 
+// bits 9-11 are ignored by the cpu, we use them to tell the page fault handler what a
+// not present entry should become
+#define PAGING_LAZY_ZERO        (1 << 10)   // table entry: map a zeroed frame on first touch
+#define PAGING_LAZY_IDENTITY    (1 << 9)    // directory entry: identity map the 4mb on first touch
+#define PAGING_LAZY_MASK        (PAGING_LAZY_ZERO | PAGING_LAZY_IDENTITY)
+#define PAGING_SHARED           (1 << 11)   // directory entry: kernel mapping owned by every directory
+#define PAGING_ENTRY_FLAGS_MASK 0xfff
+
+#define PAGING_IS_GLOBAL        (1 << 8)    // survives cr3 reloads, needs CR4.PGE
+#define PAGING_IS_4MB           (1 << 7)    // directory entry maps a 4mb page, needs CR4.PSE
 #define PAGING_CACHE_DISABLED   (1 << 4)
 #define PAGING_WRITE_THROUGH    (1 << 3)
 #define PAGING_ACCESS_FROM_ALL  (1 << 2)
@@ -16,15 +26,36 @@
 
 #define PAGING_TOTAL_ENTRIES_PER_TABLE  1024
 #define PAGING_PAGE_SIZE    4096
+#define PAGING_LARGE_PAGE_SIZE  (PAGING_TOTAL_ENTRIES_PER_TABLE * PAGING_PAGE_SIZE)
+
+#define PAGING_CPU_FEATURE_PSE  (1 << 3)
+#define PAGING_CPU_FEATURE_PGE  (1 << 13)
+
+// page fault error code bits pushed by the cpu
+#define PAGING_FAULT_PRESENT    (1 << 0)    // protection violation, not a missing page
+#define PAGING_FAULT_WRITE      (1 << 1)
+#define PAGING_FAULT_USER       (1 << 2)
 
 
 struct paging_4gb_chunk
 {
     uint32_t* directory_address;
+    struct paging_4gb_chunk* next_shared;   // next chunk built on the shared kernel entries
+};
+
+struct paging_tlb_stats
+{
+    uint32_t page_invalidations;    // invlpg instructions issued
+    uint32_t full_flushes;          // whole tlb flushes issued for a range, global entries included
 };
 
 
 struct paging_4gb_chunk* paging_create_new_4gb_chunk(uint8_t flags);
+struct paging_4gb_chunk* paging_create_new_4gb_chunk_with_page_size(uint8_t flags, bool large_pages);
+struct paging_4gb_chunk* paging_create_new_sparse_4gb_chunk(uint8_t flags);
+void paging_free_4gb_chunk(struct paging_4gb_chunk* chunk);
+bool paging_large_pages_supported();
+bool paging_global_pages_supported();
 uint32_t* paging_4gb_chunk_get_directory(struct paging_4gb_chunk* chunk);
 
 void paging_switch(uint32_t* directory);
@@ -32,6 +63,12 @@ void enable_paging();
 
 bool paging_is_aligned(void* address);
 int paging_set(uint32_t* directory, void* virt_addr, uint32_t val);
+int paging_map_range(uint32_t* directory, void* virt_addr, void* phys_addr, uint32_t total_pages, uint32_t flags);
+int paging_unmap_range(uint32_t* directory, void* virt_addr, uint32_t total_pages);
+void* paging_get_physical(uint32_t* directory, void* virt_addr);
+void paging_get_tlb_stats(struct paging_tlb_stats* stats);
+int paging_set_demand_zero(uint32_t* directory, void* virt_addr, uint32_t total_pages, uint8_t flags);
+int paging_handle_fault(void* fault_address, uint32_t error_code);
 
 
 
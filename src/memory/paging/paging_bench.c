@@ -0,0 +1,162 @@
+#include "paging_bench.h"
+#include "kernel.h"
+#include "memory/heap/kheap.h"
+#include "string/string.h"
+#include "time/tsc.h"
+
+// pages touched per pass, more than the data tlb of common cpus can hold
+#define PAGING_BENCH_TOTAL_PAGES    2048
+#define PAGING_BENCH_PASSES         16
+
+// directory switches measured, each followed by touching a few kernel pages
+#define PAGING_BENCH_SWITCHES       1024
+#define PAGING_BENCH_SWITCH_PAGES   64
+
+extern void paging_flush_tlb();
+extern void paging_enable_pge();
+extern void paging_disable_pge();
+
+//------------------------------------------------------------------------------------------------
+static void paging_bench_print(const char* label, uint32_t value)
+{
+    char buf[33];
+
+    print(label);
+    print(itoa(value,buf,10));
+    print("\n");
+}
+
+//------------------------------------------------------------------------------------------------
+static uint32_t paging_bench_touch_pages(volatile char* buffer)
+{
+    // one access per page, offset by a cache line per page so the data cache is not the bottleneck
+    uint64_t start = tsc_read();
+
+    for(int pass=0; pass<PAGING_BENCH_PASSES; pass++)
+    {
+        for(int i=0; i<PAGING_BENCH_TOTAL_PAGES; i++)
+        {
+            buffer[(i * PAGING_PAGE_SIZE) + ((i * 64) % PAGING_PAGE_SIZE)]++;
+        }
+    }
+
+    return (tsc_read() - start) / (PAGING_BENCH_PASSES * PAGING_BENCH_TOTAL_PAGES);
+}
+
+//------------------------------------------------------------------------------------------------
+static void paging_bench_flush_all()
+{
+    // a cr3 reload keeps the global kernel pages, toggling CR4.PGE drops them as well
+    if(paging_global_pages_supported())
+    {
+        paging_disable_pge();
+        paging_enable_pge();
+        return;
+    }
+
+    paging_flush_tlb();
+}
+
+//------------------------------------------------------------------------------------------------
+static uint32_t paging_bench_tlb(struct paging_4gb_chunk* chunk, volatile char* buffer)
+{
+    paging_switch(paging_4gb_chunk_get_directory(chunk));
+    paging_bench_flush_all();
+    paging_bench_touch_pages(buffer);     // warm the caches
+    return paging_bench_touch_pages(buffer);
+}
+
+//------------------------------------------------------------------------------------------------
+static uint32_t paging_bench_switch(uint32_t* first, uint32_t* second, volatile char* buffer)
+{
+    // a switch costs the cr3 write plus refilling the tlb for the kernel pages used after it
+    uint64_t start = tsc_read();
+
+    for(int i=0; i<PAGING_BENCH_SWITCHES; i++)
+    {
+        paging_switch((i & 1) ? second : first);
+
+        for(int page=0; page<PAGING_BENCH_SWITCH_PAGES; page++)
+        {
+            buffer[page * PAGING_PAGE_SIZE]++;
+        }
+    }
+
+    return (tsc_read() - start) / PAGING_BENCH_SWITCHES;
+}
+
+//------------------------------------------------------------------------------------------------
+static void paging_bench_global(struct paging_4gb_chunk* kernel_chunk, volatile char* buffer)
+{
+    // two directories sharing the kernel entries, switched back and forth with CR4.PGE off and on
+    uint8_t flags = PAGING_IS_WRITEABLE | PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL;
+    struct paging_4gb_chunk* second_chunk = paging_create_new_4gb_chunk(flags);
+
+    if(!second_chunk || !paging_global_pages_supported())
+    {
+        print("paging: global pages not available\n");
+        goto out;
+    }
+
+    uint32_t* first = paging_4gb_chunk_get_directory(kernel_chunk);
+    uint32_t* second = paging_4gb_chunk_get_directory(second_chunk);
+
+    paging_disable_pge();
+    paging_bench_switch(first,second,buffer);
+    paging_bench_print("paging: cycles/switch without global pages: ",paging_bench_switch(first,second,buffer));
+
+    paging_enable_pge();
+    paging_bench_switch(first,second,buffer);
+    paging_bench_print("paging: cycles/switch with global pages: ",paging_bench_switch(first,second,buffer));
+
+out:
+    paging_switch(paging_4gb_chunk_get_directory(kernel_chunk));
+
+    if(second_chunk)
+    {
+        paging_free_4gb_chunk(second_chunk);
+    }
+}
+
+//------------------------------------------------------------------------------------------------
+void paging_benchmark(struct paging_4gb_chunk* kernel_chunk)
+{
+    uint8_t flags = PAGING_IS_WRITEABLE | PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL;
+
+    // cost of building the identity map, as done at boot
+    uint64_t start = tsc_read();
+    struct paging_4gb_chunk* small_chunk = paging_create_new_4gb_chunk_with_page_size(flags,false);
+    uint32_t small_cycles = tsc_read() - start;
+
+    start = tsc_read();
+    struct paging_4gb_chunk* large_chunk = paging_create_new_4gb_chunk_with_page_size(flags,true);
+    uint32_t large_cycles = tsc_read() - start;
+
+    paging_bench_print("paging: 4kb chunk create cycles: ",small_cycles);
+    paging_bench_print("paging: 4mb chunk create cycles: ",large_cycles);
+
+    volatile char* buffer = kmalloc(PAGING_BENCH_TOTAL_PAGES * PAGING_PAGE_SIZE);
+    if(small_chunk && large_chunk && buffer)
+    {
+        paging_bench_print("paging: 4kb pages cycles/page touch: ",paging_bench_tlb(small_chunk,buffer));
+        paging_bench_print("paging: 4mb pages cycles/page touch: ",paging_bench_tlb(large_chunk,buffer));
+    }
+
+    if(buffer)
+    {
+        paging_bench_global(kernel_chunk,buffer);
+    }
+
+    paging_switch(paging_4gb_chunk_get_directory(kernel_chunk));
+    kfree((void*)buffer);
+
+    if(small_chunk)
+    {
+        paging_free_4gb_chunk(small_chunk);
+    }
+
+    if(large_chunk)
+    {
+        paging_free_4gb_chunk(large_chunk);
+    }
+}
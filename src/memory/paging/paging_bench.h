@@ -0,0 +1,8 @@
+#ifndef PAGING_BENCH_H
+#define PAGING_BENCH_H
+
+#include "paging.h"
+
+void paging_benchmark(struct paging_4gb_chunk* kernel_chunk);
+
+#endif
@@ -0,0 +1,142 @@
+#include "pci.h"
+#include "io/io.h"
+#include "status.h"
+#include "memory/memory.h"
+#include <stdbool.h>
+
+// configuration mechanism 1, an address is written to 0xCF8 and the data moves through 0xCFC
+#define PCI_CONFIG_ADDRESS  0xCF8
+#define PCI_CONFIG_DATA     0xCFC
+
+#define PCI_TOTAL_BUSES     256
+#define PCI_TOTAL_SLOTS     32
+#define PCI_TOTAL_FUNCTIONS 8
+
+typedef bool (*PCI_MATCH_FUNCTION)(struct pci_device* device, uint32_t a, uint32_t b);
+
+//--------------------------------------------------------------------------------
+static uint32_t pci_config_address(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset)
+{
+    return 0x80000000 | (bus << 16) | (slot << 11) | (function << 8) | (offset & 0xfc);
+}
+
+//--------------------------------------------------------------------------------
+static uint32_t pci_read(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset)
+{
+    outl(PCI_CONFIG_ADDRESS, pci_config_address(bus,slot,function,offset));
+    return insl(PCI_CONFIG_DATA);
+}
+
+//--------------------------------------------------------------------------------
+uint32_t pci_config_read(struct pci_device* device, uint8_t offset)
+{
+    return pci_read(device->bus,device->slot,device->function,offset);
+}
+
+//--------------------------------------------------------------------------------
+void pci_config_write(struct pci_device* device, uint8_t offset, uint32_t value)
+{
+    outl(PCI_CONFIG_ADDRESS, pci_config_address(device->bus,device->slot,device->function,offset));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+//--------------------------------------------------------------------------------
+static void pci_fill_device(struct pci_device* device, uint8_t bus, uint8_t slot, uint8_t function)
+{
+    memset(device,0,sizeof(struct pci_device));
+    device->bus = bus;
+    device->slot = slot;
+    device->function = function;
+
+    uint32_t id = pci_config_read(device,PCI_CONFIG_VENDOR_ID);
+    device->vendor_id = id & 0xffff;
+    device->device_id = id >> 16;
+
+    uint32_t class = pci_config_read(device,PCI_CONFIG_CLASS);
+    device->class_code = class >> 24;
+    device->subclass = (class >> 16) & 0xff;
+    device->prog_if = (class >> 8) & 0xff;
+
+    device->irq_line = pci_config_read(device,PCI_CONFIG_INTERRUPT) & 0xff;
+}
+
+//--------------------------------------------------------------------------------
+static int pci_find(PCI_MATCH_FUNCTION match, uint32_t a, uint32_t b, int index, struct pci_device* device_out)
+{
+    // brute force scan, returns the index'th function match accepts
+    struct pci_device device;
+
+    for(int bus=0; bus<PCI_TOTAL_BUSES; bus++)
+    {
+        for(int slot=0; slot<PCI_TOTAL_SLOTS; slot++)
+        {
+            if((pci_read(bus,slot,0,PCI_CONFIG_VENDOR_ID) & 0xffff) == 0xffff)
+            {
+                continue;   // nothing in this slot
+            }
+
+            // bit 7 of the header type tells whether functions 1-7 exist at all
+            int total_functions = (pci_read(bus,slot,0,PCI_CONFIG_HEADER_TYPE) & 0x800000) ? PCI_TOTAL_FUNCTIONS : 1;
+
+            for(int function=0; function<total_functions; function++)
+            {
+                if((pci_read(bus,slot,function,PCI_CONFIG_VENDOR_ID) & 0xffff) == 0xffff)
+                {
+                    continue;
+                }
+
+                pci_fill_device(&device,bus,slot,function);
+                if(!match(&device,a,b))
+                {
+                    continue;
+                }
+
+                if(index-- == 0)
+                {
+                    *device_out = device;
+                    return 0;
+                }
+            }
+        }
+    }
+
+    return -EIO;
+}
+
+//--------------------------------------------------------------------------------
+static bool pci_match_class(struct pci_device* device, uint32_t class_code, uint32_t subclass)
+{
+    return device->class_code == class_code && device->subclass == subclass;
+}
+
+//--------------------------------------------------------------------------------
+static bool pci_match_id(struct pci_device* device, uint32_t vendor_id, uint32_t device_id)
+{
+    return device->vendor_id == vendor_id && device->device_id == device_id;
+}
+
+//--------------------------------------------------------------------------------
+int pci_find_class(uint8_t class_code, uint8_t subclass, int index, struct pci_device* device_out)
+{
+    return pci_find(pci_match_class,class_code,subclass,index,device_out);
+}
+
+//--------------------------------------------------------------------------------
+int pci_find_device(uint16_t vendor_id, uint16_t device_id, int index, struct pci_device* device_out)
+{
+    return pci_find(pci_match_id,vendor_id,device_id,index,device_out);
+}
+
+//--------------------------------------------------------------------------------
+uint32_t pci_get_bar(struct pci_device* device, int bar)
+{
+    return pci_config_read(device,PCI_CONFIG_BAR0 + (bar * 4));
+}
+
+//--------------------------------------------------------------------------------
+void pci_enable_bus_master(struct pci_device* device)
+{
+    // the upper half is the status register, writing ones there would clear its bits
+    uint32_t command = pci_config_read(device,PCI_CONFIG_COMMAND) & 0xffff;
+    pci_config_write(device,PCI_CONFIG_COMMAND,command | PCI_COMMAND_IO_SPACE | PCI_COMMAND_MEMORY_SPACE | PCI_COMMAND_BUS_MASTER);
+}
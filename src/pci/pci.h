@@ -0,0 +1,47 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdint.h>
+
+#define PCI_CLASS_MASS_STORAGE  0x01
+#define PCI_SUBCLASS_IDE        0x01
+#define PCI_SUBCLASS_SATA       0x06
+#define PCI_PROG_IF_AHCI        0x01
+
+// offsets into the configuration space of a function
+#define PCI_CONFIG_VENDOR_ID    0x00
+#define PCI_CONFIG_COMMAND      0x04
+#define PCI_CONFIG_CLASS        0x08    // revision, prog if, subclass, class
+#define PCI_CONFIG_HEADER_TYPE  0x0C
+#define PCI_CONFIG_BAR0         0x10
+#define PCI_CONFIG_INTERRUPT    0x3C
+
+#define PCI_COMMAND_IO_SPACE    (1 << 0)
+#define PCI_COMMAND_MEMORY_SPACE    (1 << 1)
+#define PCI_COMMAND_BUS_MASTER  (1 << 2)
+
+#define PCI_BAR_IO      (1 << 0)    // the bar holds an io port base instead of a memory address
+#define PCI_BAR_MEMORY_MASK 0xfffffff0
+
+struct pci_device
+{
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t function;
+
+    uint16_t vendor_id;
+    uint16_t device_id;
+    uint8_t class_code;
+    uint8_t subclass;
+    uint8_t prog_if;
+    uint8_t irq_line;
+};
+
+uint32_t pci_config_read(struct pci_device* device, uint8_t offset);
+void pci_config_write(struct pci_device* device, uint8_t offset, uint32_t value);
+int pci_find_class(uint8_t class_code, uint8_t subclass, int index, struct pci_device* device_out);
+int pci_find_device(uint16_t vendor_id, uint16_t device_id, int index, struct pci_device* device_out);
+uint32_t pci_get_bar(struct pci_device* device, int bar);
+void pci_enable_bus_master(struct pci_device* device);
+
+#endif
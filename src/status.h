@@ -9,5 +9,6 @@
 #define EFSNOTUS 5
 #define ERDONLY 6
 #define EUNIMP 7
+#define ENOSPC 8
 
 #endif 
@@ -130,4 +130,29 @@ int istrncmp(const char* s1, const char* s2, int n)
         }
     }
     return 0;
+}
+
+//--------------------------------------------
+char* itoa(unsigned int value, char* str, int base)
+{
+    // converts value to a null terminated string in the given base (2-16)
+    char tmp[33];
+    int i=0;
+
+    do
+    {
+        int digit = value % base;
+        tmp[i++] = digit < 10 ? '0' + digit : 'a' + (digit-10);
+        value /= base;
+    } while(value != 0);
+
+    int len = i;
+    while(i > 0)
+    {
+        str[len-i] = tmp[i-1];
+        i--;
+    }
+    str[len] = 0x00;
+
+    return str;
 }
\ No newline at end of file
@@ -13,6 +13,7 @@ char tolower(char s1);
 int strlen_terminator(const char* str,int max,char terminator);
 int strncmp(const char* str1, const char* str2, int n);
 int istrncmp(const char* s1, const char* s2, int n);
+char* itoa(unsigned int value, char* str, int base);
 
 
 
@@ -0,0 +1,37 @@
+#include "timer.h"
+#include "config.h"
+#include "io/io.h"
+#include "idt/idt.h"
+
+// channel 0 of the programmable interval timer drives irq 0
+#define PIT_CHANNEL0    0x40
+#define PIT_COMMAND     0x43
+#define PIT_FREQUENCY   1193182
+#define PIT_CHANNEL0_RATE_GENERATOR 0x34    // low then high byte of the divisor, mode 2
+
+static volatile uint32_t timer_tick_count = 0;
+
+//--------------------------------------------------------------------------------
+static void timer_handle_interrupt()
+{
+    timer_tick_count++;
+}
+
+//--------------------------------------------------------------------------------
+void timer_init()
+{
+    uint32_t divisor = PIT_FREQUENCY / CHUCHUOS_TIMER_HZ;
+
+    outb(PIT_COMMAND, PIT_CHANNEL0_RATE_GENERATOR);
+    outb(PIT_CHANNEL0, divisor & 0xff);
+    outb(PIT_CHANNEL0, (divisor >> 8) & 0xff);
+
+    idt_register_irq_handler(0, timer_handle_interrupt);
+}
+
+//--------------------------------------------------------------------------------
+uint32_t timer_ticks()
+{
+    // wraps after 497 days at 100 hz, callers only look at differences
+    return timer_tick_count;
+}
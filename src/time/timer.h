@@ -0,0 +1,12 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "config.h"
+#include <stdint.h>
+
+#define TIMER_MS_TO_TICKS(ms)   (((ms) * CHUCHUOS_TIMER_HZ + 999) / 1000)
+
+void timer_init();
+uint32_t timer_ticks();
+
+#endif
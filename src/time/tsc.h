@@ -0,0 +1,14 @@
+#ifndef TSC_H
+#define TSC_H
+
+#include <stdint.h>
+
+// reads the time stamp counter, cpu cycles since reset
+static inline uint64_t tsc_read()
+{
+    uint32_t low, high;
+    __asm__ __volatile__("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+#endif